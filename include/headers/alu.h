@@ -0,0 +1,29 @@
+#ifndef ALU_H
+#define ALU_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Flag lookup tables for the 8 bit ALU so the eager flag path never branches on
+// the data. Every entry is in F layout (z n h c in the upper nibble)
+class AluTables {
+    public:
+        // Indexed by the value before INC/DEC. C is left for the caller to keep
+        static const std::array<uint8_t, 256> INC;
+        static const std::array<uint8_t, 256> DEC;
+
+        // Indexed by carry << 16 | a << 8 | b, ADC/SBC use the upper half. The result
+        // itself is a single add so only the flags are stored
+        static const std::array<uint8_t, 0x20000> ADD;
+        static const std::array<uint8_t, 0x20000> SUB;
+        static uint32_t index(uint8_t a, uint8_t b, uint8_t carry) { return (carry << 16) | (a << 8) | b; }
+
+        // Indexed by (F >> 4 & 7) << 8 | A, i.e. the incoming n h c and A.
+        // Holds the adjusted A in the high byte and the new F in the low byte
+        static const std::array<uint16_t, 0x800> DAA;
+
+        static size_t bytes();
+};
+
+#endif
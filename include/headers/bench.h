@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+
+// Runs the named benchmark and prints the results, returns the process exit code
+int runBenchmark(const std::string& name);
+
+#endif
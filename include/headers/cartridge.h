@@ -0,0 +1,71 @@
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// Owns the full ROM image and external RAM of a cartridge and emulates its
+// memory bank controller. Bank switching only moves the region pointers below,
+// nothing gets copied, so Memory can point its page tables straight at them.
+class Cartridge {
+    public:
+        enum class MBC { None, MBC1, MBC3, MBC5 };
+
+        static constexpr size_t ROM_BANK_SIZE = 0x4000;
+        static constexpr size_t RAM_BANK_SIZE = 0x2000;
+        static constexpr size_t MAX_ROM_SIZE = 8 * 1024 * 1024; // MBC5, 512 banks
+        static constexpr size_t MAX_RAM_SIZE = 128 * 1024;      // MBC5, 16 banks
+        static constexpr size_t SMALL_RAM_SIZE = 2 * 1024;      // RAM size code 0x01, mirrored four times
+
+        Cartridge();
+
+        void load(const std::vector<uint8_t>& rom);
+
+        // Handles a write to 0x0000-0x7FFF. Returns true if the bank mapping changed
+        bool writeRegister(uint16_t address, uint8_t value);
+
+        const uint8_t* romBank0() const { return _romBank0; } // 0x0000-0x3FFF
+        const uint8_t* romBankN() const { return _romBankN; } // 0x4000-0x7FFF
+        uint8_t* ramBank() const { return _ramBankPtr; }      // 0xA000-0xBFFF, nullptr when not directly mapped (or only 2 KiB)
+
+        // Accesses to 0xA000-0xBFFF while ramBank() is nullptr (disabled RAM, 2 KiB RAM or an MBC3 RTC register)
+        uint8_t readRAM(uint16_t address) const;
+        void writeRAM(uint16_t address, uint8_t value);
+
+        MBC type() const { return _mbc; }
+        unsigned int currentROMBank0() const { return _romBank0Index; }
+        unsigned int currentROMBank() const { return _romBankNIndex; }
+        unsigned int currentRAMBank() const { return _ramBankIndex; }
+
+    private:
+        std::vector<uint8_t> _rom;
+        std::vector<uint8_t> _ram;
+
+        MBC _mbc = MBC::None;
+        bool _hasRTC = false;
+        size_t _romBankCount = 2;
+        size_t _ramBankCount = 0;
+
+        // Raw MBC registers
+        bool _ramEnabled = false;
+        uint16_t _romBankReg = 1;
+        uint8_t _bankReg2 = 0;    // MBC1 upper bits / RAM bank, MBC3 RAM bank or RTC select, MBC5 RAM bank
+        uint8_t _bankMode = 0;    // MBC1 banking mode
+        uint8_t _latchReg = 0xFF; // MBC3 RTC latch
+        std::array<uint8_t, 5> _rtc{};
+
+        // Resolved mapping
+        unsigned int _romBank0Index = 0;
+        unsigned int _romBankNIndex = 1;
+        unsigned int _ramBankIndex = 0;
+        const uint8_t* _romBank0 = nullptr;
+        const uint8_t* _romBankN = nullptr;
+        uint8_t* _ramBankPtr = nullptr;
+        bool _ramOpen = false; // RAM enabled and the selected bank exists, whether or not it's mapped
+
+        bool updateBanks();
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <array>
+#include <cstdint>
+
+// SSE2 is part of x86-64, AVX2 is picked at runtime when the CPU has it
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_SIMD_SSE2 1
+#if defined(__GNUC__)
+#define GB_SIMD_AVX2 1
+#endif
+#endif
+
+// One scanline as colour indices, before any palette
+struct LineLayers {
+    static const unsigned int WIDTH = 160;
+    std::array<uint8_t, WIDTH> bg;   // Background and window
+    std::array<uint8_t, WIDTH> obj;  // Winning sprite pixel, 0 where there's none
+    std::array<uint8_t, WIDTH> attr; // Compositor::OBJ_* for that sprite
+};
+
+// Mixes a line's layers with DMG priority and maps them through BGP/OBP0/OBP1 to
+// RGBA8888. The SIMD paths do 16 (SSE2) or 32 (AVX2) pixels at a time and have to
+// match the scalar one bit for bit, --bench compositor checks that
+class Compositor {
+    public:
+        enum class Path { Scalar, SSE2, AVX2 };
+
+        static const uint8_t OBJ_PALETTE1 = 0x01; // OBP1 instead of OBP0
+        static const uint8_t OBJ_BEHIND_BG = 0x02; // Only shows over BG colour 0
+
+        // Shade 0-3 to RGBA, plain greys
+        static const std::array<uint32_t, 4> SHADES;
+
+        struct Palettes {
+            uint8_t bgp, obp0, obp1;
+        };
+
+        // With the fastest path this CPU supports
+        static void compose(const LineLayers& layers, Palettes palettes, uint32_t* out);
+        static void compose(Path path, const LineLayers& layers, Palettes palettes, uint32_t* out);
+
+        static Path best();
+        static bool available(Path path);
+        static const char* name(Path path);
+
+    private:
+        static void composeScalar(const LineLayers& layers, Palettes palettes, uint32_t* out);
+#ifdef GB_SIMD_SSE2
+        static void composeSSE2(const LineLayers& layers, Palettes palettes, uint32_t* out);
+#endif
+#ifdef GB_SIMD_AVX2
+        static void composeAVX2(const LineLayers& layers, Palettes palettes, uint32_t* out);
+#endif
+};
+
+#endif
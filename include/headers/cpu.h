@@ -5,10 +5,33 @@
 #include <cstdint>
 #include <vector>
 #include <map>
+#include <array>
+#include <unordered_map>
+#include <bitset>
+#include <chrono>
+#include <memory>
 #include "memory.h"
+#include "jit.h"
+#include "alu.h"
 
 class CPU {
     public:
+        using Handler = void (*)(CPU&);
+
+        // How execute() runs code: one decode per instruction, pre-decoded basic blocks,
+        // or hot blocks translated to native x86-64 (falls back to Cached elsewhere)
+        enum class ExecMode { Interpreter, Cached, JIT };
+
+        // Why run()/runUntil() returned
+        enum class RunResult {
+            Budget,     // Ran through the cycle budget
+            VBlank,     // Memory::EVENT_VBLANK fired
+            SerialByte, // Memory::EVENT_SERIAL fired
+            Halted,     // HALT with no interrupt enabled to ever wake it
+            Breakpoint, // About to execute an instruction at a breakpoint
+            Unhandled   // Hit an unused opcode, the CPU is stuck there
+        };
+
         CPU();
 
         uint16_t getAF() const;
@@ -29,11 +52,62 @@ class CPU {
         uint16_t getSP() const;
         void setSP(uint16_t val);
 
-        void step();
+        // Runs one instruction (or interrupt dispatch, or one idle halted cycle) and returns the M-cycles it took
+        unsigned int step();
+        // Runs up to count instructions, returning early if the CPU halts or stops.
+        // Scheduled device events fire in between, at most one instruction late.
+        // Returns how many ran
+        unsigned int execute(unsigned int count);
+
+        // Runs for cycles M-cycles, overshooting by at most one instruction. This is
+        // the entry point embedding code should use, e.g. one frame at a time
+        RunResult run(uint64_t cycles);
+        // Same, but also returns once one of the Memory::EVENT_* bits in events fires
+        RunResult runUntil(uint8_t events, uint64_t cycles = UINT64_MAX);
+
+        // Checked by run()/runUntil() before every instruction, which keeps them off the
+        // block cache while any breakpoint is set
+        void addBreakpoint(uint16_t address);
+        void removeBreakpoint(uint16_t address);
+        void clearBreakpoints();
+
+        // With realtime on, run() and runUntil() keep the emulated clock from getting ahead
+        // of the host one, for running interactively at 1x. Skipping through HALT/STOP
+        // sleeps the whole gap in one go
+        void setRealtime(bool realtime);
+
+        // Polling loops (wait for LY, a WRAM flag, ...) that can't change anything until
+        // the hardware does get skipped in the Cached and JIT modes. Off for verification
+        struct IdleStats {
+            uint64_t hits = 0;   // Times a loop was skipped
+            uint64_t cycles = 0; // M-cycles skipped
+        };
+        void setIdleSkipping(bool enabled);
+        const IdleStats& idleStats() const { return _idleStats; }
+
+        // Counts every executed (opcode, next opcode) pair, for tuning the fused
+        // instructions in opcodes.cpp. Runs everything through step() while on
+        void setPairProfiling(bool enabled);
+        struct OpcodePair {
+            uint8_t first;
+            uint8_t second;
+            uint64_t count;
+        };
+        std::vector<OpcodePair> topOpcodePairs(size_t n) const;
+        // True when the block cache runs this pair as part of a fused instruction
+        static bool isFusedPair(uint8_t first, uint8_t second);
+
+        // M-cycles since power on, never wraps in practice
+        uint64_t cycles() const { return _cycles; }
+
+        void setExecMode(ExecMode mode);
+        ExecMode execMode() const;
 
         void loadROM(const std::vector<uint8_t>& rom);
 
         uint8_t peek(uint16_t addr) const;
+        const PPU& ppu() const { return _mem.ppu(); }
+        PPU& ppu() { return _mem.ppu(); }
         bool isHalted() const;
         bool interruptPending();
 
@@ -51,23 +125,157 @@ class CPU {
         // _F register contains flags: z n h c // zero subtraction half carry carry
         // These live in the upper 4 bits of F the lower 4 bits do not get used
 
-        // Interrupt flag
+#ifdef GB_LAZY_FLAGS
+        // With lazy flags the ALU only records what it did. Z and C come straight out
+        // of _flagResult (low byte and bit 8), N and H are either worked out from the
+        // operands or, for FlagOp::Fixed, taken from _F
+        enum class FlagOp : uint8_t { Fixed, Add, Sub };
+        FlagOp _flagOp = FlagOp::Fixed;
+        uint8_t _flagA = 0, _flagB = 0;
+        uint16_t _flagResult = 0;
+#endif
+
+        // Everything reads and writes flags through these so GB_LAZY_FLAGS can swap the representation
+        uint8_t flags() const;
+        void setFlags(uint8_t f);
+        bool flagZ() const;
+        bool flagC() const;
+        // a + b + carry and a - b - carry, setting all four flags
+        uint8_t add8(uint8_t a, uint8_t b, uint8_t carry);
+        uint8_t sub8(uint8_t a, uint8_t b, uint8_t carry);
+        // INC/DEC keep C
+        void flagsInc(uint8_t old, uint8_t result);
+        void flagsDec(uint8_t old, uint8_t result);
+        // AND/OR/XOR, h is 0x20 for AND
+        void flagsLogic(uint8_t result, uint8_t h);
+
+        // Interrupt flag, only ever changed through setIME so Memory can fold it into its pending mask
         bool _IME;
         bool _imeScheduled;
+        void setIME(bool ime) {
+            _IME = ime;
+            _mem.setInterruptMaster(ime);
+        }
 
         uint16_t _PC, _SP; // Program counter/ Pointer and Stack Pointer
 
         void push16(uint16_t val);
         uint16_t pop16();
 
-        bool _stopped = false;
+        bool _stopped = false; // STOP also sets _halted, but only the joypad wakes it
         bool _halted = false;
-
-        void executeOpcode(uint8_t opcode);
+        bool _unhandled = false; // Set together with _halted by an unused opcode
+
+        std::bitset<0x10000> _breakpoints;
+        unsigned int _breakpointCount = 0;
+
+        bool _realtime = false;
+        std::chrono::steady_clock::time_point _realtimeStart;
+        uint64_t _realtimeCycles = 0; // _cycles at _realtimeStart
+        static constexpr double CYCLES_PER_SECOND = 1048576.0;
+
+        bool wakePending();
+        bool fastForward(uint64_t target);
+        void waitForHost(uint64_t cycle); // Realtime only, sleeps until the host clock reaches cycle
+
+        // Opcode handlers are generated from the opcode encoding in opcodes.cpp
+        struct Ops;
+        static const std::array<Handler, 256> _opTable;
+        static const std::array<Handler, 256> _cbTable;
+        static const std::array<uint8_t, 256> _opLength;
+        // M-cycles per opcode, conditional ones not taken/taken. CB instructions are in
+        // _cbCycles (prefix included), _opCycles[0xCB] is 0
+        static const std::array<uint8_t, 256> _opCycles;
+        static const std::array<uint8_t, 256> _opCyclesTaken;
+        static const std::array<uint8_t, 256> _cbCycles;
+        static const unsigned int INTERRUPT_CYCLES = 5;
+        static const unsigned int MAX_OP_CYCLES = 6; // CALL, lets run() size execute() batches
+
+        // Every handler adds its own cost, so all execution modes count time the same way
+        uint64_t _cycles = 0;
+
+        // One slice of execute() that can't cross a device deadline. These return how
+        // many of the count instructions were left when they stopped
+        unsigned int executeBatch(unsigned int count);
+
+        // Immediate operand of the current instruction, decoded by step() before the handler runs.
+        // Fused instructions pack the operand bytes of all their parts in here, in order
+        uint32_t _operand = 0;
+        uint8_t imm8() const { return _operand & 0xFF; }
+        uint16_t imm16() const { return _operand & 0xFFFF; }
+
+        // Opcode sequences the block cache runs as one handler, see opcodes.cpp
+        static const unsigned int MAX_FUSED = 4;
+        struct Fusion {
+            uint8_t count;
+            std::array<uint8_t, MAX_FUSED> opcodes;
+            Handler handler;
+        };
+        static const std::vector<Fusion> _fusions;
 
         uint8_t fetch8();
         uint16_t fetch16();
 
+        // Basic block cache, see blockcache.cpp
+        struct DecodedOp {
+            Handler handler;
+            uint32_t operand;
+            uint8_t length;
+            uint8_t opcode;    // First opcode of a fused instruction
+            uint8_t count = 1; // Instructions this stands for
+        };
+        // Translated block, returns how many instructions it ran before leaving
+        using NativeBlock = uint32_t (*)(CPU*);
+        struct Block {
+            std::vector<DecodedOp> ops;
+            uint32_t generation;
+            uint16_t start = 0;
+            uint32_t instructions = 0; // ops.size() before fusion
+            uint32_t hits = 0;
+            NativeBlock native = nullptr;
+            // Last block that followed this one, valid while Memory::sideEffects() is unchanged
+            Block* next = nullptr;
+            uint16_t nextPC = 0;
+            uint32_t nextSideEffects = 0;
+            // Jumps back to its own start without writing memory, see isIdleLoop
+            bool idle = false;
+        };
+        struct BlockSlot {
+            uint32_t key;
+            Block* block;
+        };
+        static const unsigned int MAX_BLOCK_OPS = 32;
+        static const unsigned int BLOCK_SLOTS = 1024;
+        static const unsigned int JIT_THRESHOLD = 16; // Runs before a block gets translated
+
+        ExecMode _execMode = ExecMode::Cached;
+        std::unordered_map<uint32_t, Block> _blocks;
+        std::array<BlockSlot, BLOCK_SLOTS> _blockSlots;
+
+        Block* fetchBlock();
+        void compileBlock(Block& block);
+        unsigned int executeCached(unsigned int count);
+
+        static const unsigned int MAX_IDLE_OPS = 8;
+        bool _idleSkipping = true;
+        IdleStats _idleStats;
+        uint64_t registerState() const;
+        void skipIdle(const Block& block, uint64_t cyclesPerPass, unsigned int& count);
+        void fuseBlock(Block& block);
+
+        std::unique_ptr<std::array<uint64_t, 0x10000>> _pairCounts;
+        int _previousOpcode = -1;
+
+        // x86-64 translation of hot blocks, see jit.cpp
+        JitArena _jit;
+        bool compileNative(Block& block);
+        void translate(Block& block);
+
+#ifdef GB_THREADED_DISPATCH
+        // Computed goto loop in opcodes.cpp, every handler jumps straight to the next one
+        unsigned int executeThreaded(unsigned int count);
+#endif
+
         void setINCFlags(uint8_t& r);
         void setDECFlags(uint8_t& r);
 
@@ -98,6 +306,8 @@ class CPU {
 
         void SWAP(uint8_t& r);
 
+        void DAA();
+
         // Bit Ops
         void BIT(uint8_t& r, int n);
         void SET(uint8_t& r, int n);
@@ -109,4 +319,95 @@ class CPU {
         
 };
 
-#endif
\ No newline at end of file
+#ifdef GB_LAZY_FLAGS
+
+inline uint8_t CPU::flags() const {
+    uint8_t f = (_flagResult & 0xFF) ? 0 : 0x80;
+    if (_flagResult & 0x100) f |= 0x10;
+    if (_flagOp == FlagOp::Fixed) {
+        return f | (_F & 0x60);
+    }
+    if (_flagOp == FlagOp::Sub) f |= 0x40;
+    if ((_flagA ^ _flagB ^ _flagResult) & 0x10) f |= 0x20;
+    return f;
+}
+
+inline void CPU::setFlags(uint8_t f) {
+    _F = f & 0xF0;
+    _flagOp = FlagOp::Fixed;
+    _flagResult = ((f & 0x10) << 4) | ((f & 0x80) ? 0 : 1);
+}
+
+inline bool CPU::flagZ() const { return (_flagResult & 0xFF) == 0; }
+inline bool CPU::flagC() const { return _flagResult & 0x100; }
+
+inline uint8_t CPU::add8(uint8_t a, uint8_t b, uint8_t carry) {
+    _flagOp = FlagOp::Add;
+    _flagA = a;
+    _flagB = b;
+    _flagResult = a + b + carry;
+    return _flagResult & 0xFF;
+}
+
+inline uint8_t CPU::sub8(uint8_t a, uint8_t b, uint8_t carry) {
+    _flagOp = FlagOp::Sub;
+    _flagA = a;
+    _flagB = b;
+    _flagResult = (a - b - carry) & 0x1FF; // Wraps, so bit 8 is the borrow
+    return _flagResult & 0xFF;
+}
+
+inline void CPU::flagsInc(uint8_t old, uint8_t result) {
+    _flagOp = FlagOp::Add;
+    _flagA = old;
+    _flagB = 1;
+    _flagResult = (_flagResult & 0x100) | result;
+}
+
+inline void CPU::flagsDec(uint8_t old, uint8_t result) {
+    _flagOp = FlagOp::Sub;
+    _flagA = old;
+    _flagB = 1;
+    _flagResult = (_flagResult & 0x100) | result;
+}
+
+inline void CPU::flagsLogic(uint8_t result, uint8_t h) {
+    _F = h;
+    _flagOp = FlagOp::Fixed;
+    _flagResult = result;
+}
+
+#else
+
+inline uint8_t CPU::flags() const { return _F; }
+inline void CPU::setFlags(uint8_t f) { _F = f & 0xF0; }
+inline bool CPU::flagZ() const { return _F & 0x80; }
+inline bool CPU::flagC() const { return _F & 0x10; }
+
+// Eager flags come out of the tables in alu.cpp
+inline uint8_t CPU::add8(uint8_t a, uint8_t b, uint8_t carry) {
+    _F = AluTables::ADD[AluTables::index(a, b, carry)];
+    return a + b + carry;
+}
+
+inline uint8_t CPU::sub8(uint8_t a, uint8_t b, uint8_t carry) {
+    _F = AluTables::SUB[AluTables::index(a, b, carry)];
+    return a - b - carry;
+}
+
+inline void CPU::flagsInc(uint8_t old, uint8_t) {
+    _F = (_F & 0x10) | AluTables::INC[old]; // Keep C flag only
+}
+
+inline void CPU::flagsDec(uint8_t old, uint8_t) {
+    _F = (_F & 0x10) | AluTables::DEC[old];
+}
+
+inline void CPU::flagsLogic(uint8_t result, uint8_t h) {
+    _F = h;
+    if (result == 0) _F |= 0x80;
+}
+
+#endif
+
+#endif
\ No newline at end of file
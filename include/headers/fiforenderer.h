@@ -0,0 +1,62 @@
+#ifndef FIFORENDERER_H
+#define FIFORENDERER_H
+
+#include <array>
+#include <cstdint>
+#include "linerenderer.h"
+
+// The DMG pixel pipeline a dot at a time: a BG fetcher filling an 8 pixel FIFO,
+// sprites merged into their own FIFO as the output reaches them, and the two mixed
+// through the palettes as each pixel goes out. The PPU runs it up to the current
+// dot before every write it could see, so SCX, palette and LCDC changes in the
+// middle of a line land on the right pixel. Mode 3 stretches the way the hardware's
+// does: SCX & 7 discarded pixels, 6 dots to restart for the window and 6-11 dots a
+// sprite. Shares the caches, the framebuffer and the window line with LineRenderer
+class FifoRenderer : public LineRenderer {
+    public:
+        static const bool MID_LINE = true;
+
+        explicit FifoRenderer(const uint8_t* mem) : LineRenderer(mem) {}
+
+        // At the start of mode 3
+        void beginLine(unsigned int ly);
+        // Runs until dots into mode 3, true once all 160 pixels are out
+        bool runTo(uint64_t dots);
+
+        // How long mode 3 of ly takes with the registers and OAM as they are now, in
+        // M-cycles. Changes later in the line can still stretch the real thing
+        uint64_t mode3Cycles(unsigned int ly) const;
+
+    private:
+        static const unsigned int FETCH_DOTS = 12;  // Before the first pixel, the first fetch is thrown away
+        static const unsigned int WINDOW_DOTS = 6;  // Restarting the fetcher on the window
+        static unsigned int spritePenalty(uint8_t x, uint8_t scx) {
+            unsigned int fine = (x + scx) & 7;
+            return 6 + (fine < 5 ? 5 - fine : 0);
+        }
+
+        unsigned int _ly = 0;
+        uint64_t _dot = 0;
+        unsigned int _x = 0;       // Next pixel out
+        unsigned int _stall = 0;   // Dots the fetcher still needs before pixels move again
+        unsigned int _discard = 0; // Pixels to drop off the front, SCX & 7 or the window's WX < 7
+        unsigned int _fetchX = 0;  // Tile column the fetcher is on, from the map or window start
+        bool _window = false;      // Window covers this line (LCDC, WY), read at the start
+        bool _inWindow = false;    // Fetching the window now
+
+        std::array<uint8_t, 8> _bg;
+        unsigned int _bgHead = 0, _bgCount = 0;
+        // Lined up with the output, slot (_objHead + i) & 7 is pixel _x + i. Colour 0 is empty
+        std::array<uint8_t, 8> _objColor;
+        std::array<uint8_t, 8> _objFlags;
+        unsigned int _objHead = 0;
+
+        std::array<uint8_t, SpriteBuckets::LINE_LIMIT> _lineSprites;
+        unsigned int _spriteCount = 0, _nextSprite = 0;
+
+        void fetchBackground();
+        void fetchSprite(unsigned int sprite);
+        void outputPixel();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ppu.h"
+
+// Writes frames out for headless runs: chosen ones as PNGs (SDL3_image, no video
+// init needed) and every one to a Y4M stream. The emulation thread only copies the
+// framebuffer into a queue slot, converting, encoding and the file I/O all happen on
+// the writer thread. The queue holds QUEUE_FRAMES, when the writer falls that far
+// behind capture() waits for it rather than lose a frame of the video
+class FrameWriter {
+    public:
+        static const size_t QUEUE_FRAMES = 8;
+
+        FrameWriter();
+        ~FrameWriter(); // finish()es
+
+        // path or "-" for stdout, anything fopen can write to (a named pipe too). False
+        // (and why on cerr) if it can't be opened
+        bool openY4M(const std::string& path);
+        // Frame n (1 for the first vblank) goes to prefix + n + ".png"
+        void savePNGs(const std::set<uint64_t>& frames, const std::string& prefix);
+
+        // Whether capture() has anything to do with frame n
+        bool wants(uint64_t frame) const { return _y4m || _pngFrames.count(frame); }
+        // Emulation thread, framebuffer as PPU::framebuffer() gives it
+        void capture(uint64_t frame, const uint32_t* framebuffer);
+        // Writes out everything captured, closes the stream and stops the thread
+        void finish();
+
+        uint64_t framesWritten() const { return _written; } // Once finished
+        uint64_t stalls() const { return _stalls; } // Captures that had to wait for a slot
+
+    private:
+        using Frame = std::array<uint32_t, PPU::WIDTH * PPU::HEIGHT>;
+        struct Slot {
+            Frame pixels;
+            uint64_t number;
+        };
+
+        std::set<uint64_t> _pngFrames;
+        std::string _pngPrefix;
+        std::FILE* _y4m = nullptr;
+        bool _y4mFailed = false;
+        std::vector<uint8_t> _yuv; // Writer thread's conversion buffer, one Y4M frame
+
+        // Slots [_tail, _tail + _count) are full, the writer only touches them between
+        // taking one and handing it back, so the copies in and out happen unlocked
+        std::array<Slot, QUEUE_FRAMES> _slots;
+        size_t _tail = 0;
+        size_t _count = 0;
+        bool _stopping = false;
+        std::mutex _mutex;
+        std::condition_variable _filled;
+        std::condition_variable _freed;
+
+        uint64_t _written = 0;
+        uint64_t _stalls = 0;
+
+        std::thread _thread; // Last, it starts running in the constructor
+
+        void run();
+        void write(const Slot& slot);
+        void writeY4M(const Frame& frame);
+        void writePNG(const Frame& frame, uint64_t number);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// The recompiler only knows how to emit x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_JIT_AVAILABLE 1
+#endif
+
+// Executable memory for translated blocks. Code is bump allocated and only ever
+// freed all at once, the CPU drops every translation when the arena fills up.
+class JitArena {
+    public:
+        static constexpr size_t SIZE = 4 * 1024 * 1024;
+
+        JitArena();
+        ~JitArena();
+        JitArena(const JitArena&) = delete;
+        JitArena& operator=(const JitArena&) = delete;
+
+        // Copies code into the arena, returns nullptr when it doesn't fit (or there is no arena)
+        uint8_t* add(const uint8_t* code, size_t size);
+        void reset();
+
+    private:
+        uint8_t* _base = nullptr;
+        size_t _used = 0;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LINERENDERER_H
+#define LINERENDERER_H
+
+#include <array>
+#include <cstdint>
+#include "tilecache.h"
+#include "spritebuckets.h"
+
+// Draws DMG scanlines from a copy of the bus: VRAM, OAM and the LCD registers are
+// read from mem when a line is drawn. Knows nothing about timing, the PPU tells it
+// which line to draw and when, and what changed in between
+class LineRenderer {
+    public:
+        static const unsigned int WIDTH = 160;
+        static const unsigned int HEIGHT = 144;
+        static const bool MID_LINE = false; // Whole lines at the start of mode 3
+
+        // mem is a whole 64 KiB bus array
+        explicit LineRenderer(const uint8_t* mem);
+
+        // After a write to the bus array has landed
+        void vramWritten(uint16_t address) {
+            if (address < 0x9800) {
+                _tiles.invalidate(address);
+            }
+        }
+        void oamWritten(uint16_t address) { _sprites.oamWritten(address); }
+        void lcdcWritten(uint8_t value) { _sprites.setHeight((value & 0x04) ? 16 : 8); }
+
+        void startFrame() { _windowLine = 0; }
+        void renderLine(unsigned int ly);
+        void clear(); // LCD off, all white
+
+        // Takes over another renderer's picture and window line, and drops whatever was
+        // cached from this one's bus array, which may have missed writes in the meantime
+        void resync(const LineRenderer& from);
+
+        const uint32_t* framebuffer() const { return _framebuffer.data(); }
+        // Whether any pixel has changed since the last call, lets a repeated frame be skipped
+        bool takeChanged() {
+            bool changed = _changed;
+            _changed = false;
+            return changed;
+        }
+        uint64_t hash() const; // FNV-1a over the framebuffer
+        const TileCacheStats& tileCacheStats() const { return _tiles.stats(); }
+
+    protected:
+        const uint8_t* _mem;
+        std::array<uint32_t, WIDTH * HEIGHT> _framebuffer;
+        TileCache _tiles;
+        SpriteBuckets _sprites;
+        unsigned int _windowLine = 0;
+        bool _changed = true;
+
+        // Tile cache index for a tile number from a map. 0x8000 addressing counts up from the
+        // start of VRAM, 0x8800 is signed around 0x9000
+        void storeLine(unsigned int ly, const std::array<uint32_t, WIDTH>& line);
+
+        static unsigned int tileIndex(uint8_t tile, bool signedTiles) {
+            return signedTiles ? 256 + static_cast<int8_t>(tile) : tile;
+        }
+};
+
+#endif
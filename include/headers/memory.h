@@ -6,11 +6,26 @@
 #include <cstdint>
 #include <iostream>
 #include <array>
+#include <bitset>
+#include "cartridge.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "ppu.h"
 
 
 class Memory {
     public:
         static const unsigned int SIZE = 0x10000; // 8 KiB of working RAM
+        // The address space is split into 256 byte pages. Each page either points
+        // straight at its backing storage or is nullptr, which sends the access
+        // down the slow path (MBC registers, disabled external RAM, IO)
+        static const unsigned int PAGE_SHIFT = 8;
+        static const unsigned int PAGE_SIZE = 1 << PAGE_SHIFT;
+        static const unsigned int PAGE_COUNT = SIZE >> PAGE_SHIFT;
+        // HRAM shares the last page with the IO registers, so writes to it get their own check
+        static const uint16_t HRAM_START = 0xFF80;
+        static const uint16_t HRAM_END = 0xFFFE;
+
         Memory();
         // Read data
         uint8_t read(uint16_t address) const;
@@ -18,13 +33,165 @@ class Memory {
         void write(uint16_t address, uint8_t value);
         void loadROM(const std::vector<uint8_t>& rom); // Check size of roms and make sure all these values are correct
 
-        std::string serial_log;
+        // Used by the CPU block cache to spot bank switches and self-modifying code
+        uint32_t codeKey(uint16_t address) const; // Unique per backing byte, so it changes with the selected bank
+        void watchCode(uint16_t address, uint16_t length); // Writes to these bytes bump the page generation
+        uint32_t pageGeneration(uint16_t address) const { return _pageGeneration[homePage(address)]; }
+        uint32_t sideEffects() const { return _sideEffects; } // Bumped by writes that can move code or a deadline
+        const uint32_t* sideEffectsCounter() const { return &_sideEffects; } // For translated code to compare against
+
+        // Hardware events CPU::runUntil can stop on. Raising one that is in the event
+        // mask sets stop, and the CPU returns after the current instruction
+        static const uint8_t EVENT_VBLANK = 0x01;
+        static const uint8_t EVENT_SERIAL = 0x02;
+        void raiseEvent(uint8_t event);
+        void setEventMask(uint8_t mask); // Also clears the raised events and stop
+        uint8_t events() const { return _events; }
+        bool eventRaised() const { return _events & _eventMask; }
+
+        // IE & IF, kept up to date by writes to either register so checking for an
+        // interrupt doesn't take two bus reads. dispatchableInterrupts() also folds in
+        // the CPU's IME, which makes "take an interrupt now?" a single test
+        uint8_t pendingInterrupts() const { return _pendingInterrupts; }
+        uint8_t dispatchableInterrupts() const { return _dispatchableInterrupts; }
+        void setInterruptMaster(bool ime);
+        void requestInterrupt(uint8_t bit); // For devices, sets the bit in IF
+
+        // The CPU's cycle counter, devices use it to work out where they are on reads and writes
+        void setClock(const uint64_t* cycles) { _clock = cycles; }
+        uint64_t now() const { return _clock ? *_clock : 0; }
+
+        // Cycle of the next thing the hardware will do on its own (timer overflow, LCD
+        // line, serial transfer), UINT64_MAX when nothing is coming. The CPU runs up to
+        // it and then calls runEvents, HALT and STOP skip straight to it
+        Scheduler& scheduler() { return _scheduler; }
+        uint64_t nextEventCycle() const { return _scheduler.nextCycle(); }
+        void runEvents(uint64_t now);
+
+        // Earliest cycle a register read since resetReadHorizon() could start reading
+        // differently. Registers worked out from the clock (DIV, TIMA) change without an
+        // event, so the idle loop skipper needs this on top of nextEventCycle()
+        void resetReadHorizon() { _readHorizon = UINT64_MAX; }
+        uint64_t readHorizon() const { return _readHorizon; }
+
+        const PPU& ppu() const { return _ppu; }
+        PPU& ppu() { return _ppu; }
 
-        bool stop;
+        // Internal clock serial runs at 8192 Hz, so a byte takes 1024 M-cycles
+        static const uint64_t SERIAL_BYTE_CYCLES = 1024;
 
-        bool ram_enabled = false;
-        std::array<uint8_t, 0x2000> ext_ram;
+        std::string serial_log;
+
+        // Tells the CPU to leave its execution loop after the current instruction: a
+        // requested event fired, or a device deadline moved in mid batch
+        bool stop = false;
     private:
-        std::array<uint8_t, SIZE> _mem;
+        std::array<uint8_t, SIZE> _mem{}; // Zeroed up front, _ppu gets a pointer into it before the constructor body
+        Cartridge _cart;
+
+        std::array<const uint8_t*, PAGE_COUNT> _readPages;
+        std::array<uint8_t*, PAGE_COUNT> _writePages;
+        std::array<uint8_t*, PAGE_COUNT> _writeTargets; // What _writePages holds when the page isn't watched
+
+        std::array<bool, PAGE_COUNT> _codePages;
+        std::array<std::bitset<PAGE_SIZE>, PAGE_COUNT> _codeBytes;
+        std::array<uint32_t, PAGE_COUNT> _pageGeneration;
+        uint32_t _sideEffects = 0;
+
+        uint8_t _events = 0;
+        uint8_t _eventMask = 0;
+
+        const uint64_t* _clock = nullptr;
+        Scheduler _scheduler;
+
+        static void serialDone(void* context, uint64_t cycle);
+
+        PPU _ppu;
+        static void ppuEvent(void* context, uint64_t cycle);
+        void schedulePPU();
+        void writeLCD(uint16_t address, uint8_t value);
+
+        Timer _timer;
+        mutable uint64_t _readHorizon = UINT64_MAX;
+        static void timerOverflow(void* context, uint64_t cycle);
+        void scheduleTimer();
+        void scheduleDevice(Scheduler::Event event, uint64_t cycle);
+
+        bool _interruptMaster = false;
+        uint8_t _pendingInterrupts = 0;
+        uint8_t _dispatchableInterrupts = 0;
+        void updateInterrupts();
+
+        uint8_t readSlow(uint16_t address) const;
+        void writeSlow(uint16_t address, uint8_t value);
+
+        void mapPages(uint16_t start, uint16_t end, const uint8_t* read, uint8_t* write);
+        void mapCartridge();
+
+        // Echo RAM (0xE000-0xFDFF) is 0xC000-0xDDFF again, code in either is tracked
+        // under the WRAM page
+        static unsigned int homePage(uint16_t address) {
+            unsigned int page = address >> PAGE_SHIFT;
+            return page >= 0xE0 && page <= 0xFD ? page - 0x20 : page;
+        }
+        // The echo page showing the same bytes as page, or page itself if there isn't one
+        static unsigned int echoPage(unsigned int page) { return page >= 0xC0 && page <= 0xDD ? page + 0x20 : page; }
+        void setWatched(unsigned int page, bool watched); // Both views of the page
 };
-#endif
\ No newline at end of file
+
+// Kept in the header so the page lookup inlines into CPU::fetch8 and friends
+inline uint8_t Memory::read(uint16_t address) const {
+    const uint8_t* page = _readPages[address >> PAGE_SHIFT];
+    if (page) {
+        return page[address & (PAGE_SIZE - 1)];
+    }
+    return readSlow(address);
+}
+
+inline void Memory::raiseEvent(uint8_t event) {
+    _events |= event;
+    if (event & _eventMask) {
+        stop = true;
+    }
+}
+
+inline void Memory::setEventMask(uint8_t mask) {
+    _eventMask = mask;
+    _events = 0;
+    stop = false;
+}
+
+inline void Memory::runEvents(uint64_t now) {
+    if (_scheduler.nextCycle() <= now) {
+        _scheduler.run(now);
+    }
+}
+
+inline void Memory::updateInterrupts() {
+    _pendingInterrupts = _mem[0xFFFF] & _mem[0xFF0F] & 0x1F;
+    _dispatchableInterrupts = _interruptMaster ? _pendingInterrupts : 0;
+}
+
+inline void Memory::setInterruptMaster(bool ime) {
+    _interruptMaster = ime;
+    updateInterrupts();
+}
+
+inline void Memory::requestInterrupt(uint8_t bit) {
+    _mem[0xFF0F] |= 1 << bit;
+    updateInterrupts();
+}
+
+inline void Memory::write(uint16_t address, uint8_t value) {
+    uint8_t* page = _writePages[address >> PAGE_SHIFT];
+    if (page) {
+        page[address & (PAGE_SIZE - 1)] = value;
+        return;
+    }
+    if (address >= HRAM_START && address <= HRAM_END && !_codePages[HRAM_START >> PAGE_SHIFT]) {
+        _mem[address] = value;
+        return;
+    }
+    writeSlow(address, value);
+}
+#endif
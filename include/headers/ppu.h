@@ -0,0 +1,150 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "linerenderer.h"
+#ifdef GB_PIXEL_FIFO
+#include "fiforenderer.h"
+#endif
+
+class RenderThread;
+
+// DMG LCD controller. Nothing here runs per dot: LY and the STAT mode are worked
+// out from the cycle counter when read, and lines get drawn late, when the CPU is
+// about to change something they depend on (VRAM, OAM, an LCD register) or the
+// frame ends. The only scheduled events are vblank and STAT interrupts.
+//
+// Renderer does the pixels. LineRenderer draws a whole line at the start of mode 3
+// and FifoRenderer (MID_LINE) runs a pixel FIFO up to the current dot, so register
+// writes land mid-line and mode 3 gets longer with SCX, the window and sprites.
+// Which one PPU is gets picked at compile time, see the bottom of this file
+template <typename Renderer>
+class BasicPPU {
+    public:
+        static const unsigned int WIDTH = 160;
+        static const unsigned int HEIGHT = 144;
+        static const uint64_t NEVER = UINT64_MAX;
+
+        // M-cycles. MODE3_CYCLES is the shortest mode 3, the only one LineRenderer knows
+        static const uint64_t LINE_CYCLES = 114;
+        static const uint64_t LINES = 154;
+        static const uint64_t FRAME_CYCLES = LINE_CYCLES * LINES;
+        static const uint64_t MODE2_CYCLES = 20;
+        static const uint64_t MODE3_CYCLES = 43;
+        static const bool VARIABLE_MODE3 = Renderer::MID_LINE;
+
+        // IF bits returned by the event and register write hooks
+        static const uint8_t IRQ_VBLANK = 0x01;
+        static const uint8_t IRQ_STAT = 0x02;
+
+        // mem is the whole 64 KiB bus array, registers, VRAM and OAM are read straight from it
+        explicit BasicPPU(const uint8_t* mem);
+        ~BasicPPU();
+
+        // Draws every line whose mode 3 started before now
+        void catchUp(uint64_t now);
+        // After a VRAM, OAM (DMA too) or LCD register write has landed, for whatever the
+        // renderer caches. LY and DMA writes don't need to come through here
+        void vramWritten(uint16_t address) {
+            if (_thread) {
+                journal(address);
+            } else {
+                _renderer.vramWritten(address);
+            }
+        }
+        void oamWritten(uint16_t address) {
+            if (_thread) {
+                journal(address);
+            } else {
+                _renderer.oamWritten(address);
+            }
+        }
+        void lcdWritten(uint16_t address);
+
+        uint8_t read(uint16_t address, uint64_t now) const; // LY and STAT
+        // After an LCDC, STAT or LYC write has landed in memory. Returns IRQ_STAT if the
+        // write raised the STAT line
+        uint8_t registerWritten(uint16_t address, uint8_t value, uint64_t now);
+
+        // The event the scheduler should fire next, strictly after the given cycle
+        uint64_t nextEvent(uint64_t after) const;
+        // Handles the event scheduled for cycle, returns the interrupts it raises
+        uint8_t fire(uint64_t cycle, uint64_t now);
+        // First cycle after now the register at address can read differently
+        uint64_t nextChange(uint16_t address, uint64_t now) const;
+
+        // Draws on a RenderThread instead of inline. Same pixels, this thread only keeps
+        // the timing and journals the writes. Can be switched either way at any point.
+        // The journal only marks line starts, so there's none for a MID_LINE renderer
+        void setRenderThread(bool enabled);
+        bool renderThread() const { return _thread != nullptr; }
+        // Which frames get drawn, decided as each frame starts. LY, STAT, the interrupts and
+        // the LY=LYC compare run the same either way, a skipped frame just leaves the last
+        // drawn one in the framebuffer. n is for EveryNth
+        enum class DrawPolicy { EveryFrame, EveryNth, OnRequest, Never };
+        void setDrawPolicy(DrawPolicy policy, unsigned int n = 1);
+        void requestFrame() { _frameRequested = true; } // For OnRequest, the next frame to start gets drawn
+        uint64_t framesDrawn() const { return _framesDrawn; }
+
+        // Records a hash of every frame as vblank starts, for checking renderers against each other
+        void setFrameHashing(bool enabled) { _hashFrames = enabled; }
+        const std::vector<uint64_t>& frameHashes();
+
+        // RGBA8888, one uint32_t per pixel, rows top to bottom. With the render thread
+        // on this waits for it to catch up
+        const uint32_t* framebuffer() const;
+        // Whether any pixel has changed since the last call, for skipping repeated frames
+        bool framebufferChanged();
+        uint64_t frames() const { return _frames; } // Completed frames, bumped at vblank
+        bool enabled() const { return _enabled; }
+        const TileCacheStats& tileCacheStats() const { return _renderer.tileCacheStats(); } // Inline renderer only
+
+    private:
+        const uint8_t* _mem;
+        Renderer _renderer;
+        std::unique_ptr<RenderThread> _thread;
+        bool _hashFrames = false;
+        DrawPolicy _drawPolicy = DrawPolicy::EveryFrame;
+        unsigned int _drawEvery = 1;
+        bool _frameRequested = false;
+        bool _drawing = true; // Whether the current frame is being drawn
+        uint64_t _framesDrawn = 0;
+        std::vector<uint64_t> _frameHashes;
+
+        bool _enabled = false;
+        uint64_t _start = 0;    // Cycle the LCD was turned on, LY 0 of a frame starts every FRAME_CYCLES after
+        uint64_t _nextLine = 0; // Lines since _start that have been drawn (or skipped over in vblank)
+        uint8_t _stat = 0; // Interrupt enables, bits 3-6
+        uint8_t _lyc = 0;
+        uint64_t _frames = 0;
+        bool _lineOpen = false; // MID_LINE only, mode 3 of the last line begun hasn't been run to the end
+
+        unsigned int line(uint64_t cycle) const { return ((cycle - _start) / LINE_CYCLES) % LINES; }
+        unsigned int dot(uint64_t cycle) const { return (cycle - _start) % LINE_CYCLES; }
+        uint64_t mode3Cycles(unsigned int ly) const {
+            if constexpr (Renderer::MID_LINE) {
+                return _renderer.mode3Cycles(ly);
+            }
+            return MODE3_CYCLES;
+        }
+        uint8_t mode(uint64_t cycle) const;
+        bool statLine(uint64_t cycle) const; // The OR of every enabled STAT source
+        bool statRises(uint64_t cycle) const;
+        bool isVBlankStart(uint64_t cycle) const;
+
+        void journal(uint16_t address); // Passes a write on to the render thread
+        bool drawsNextFrame();
+        bool runLine(uint64_t now); // MID_LINE only, true once the open line is finished
+};
+
+// -DGB_PIXEL_FIFO for the accurate renderer. The other one doesn't get instantiated,
+// so the default build doesn't carry any of it
+#ifdef GB_PIXEL_FIFO
+using PPU = BasicPPU<FifoRenderer>;
+#else
+using PPU = BasicPPU<LineRenderer>;
+#endif
+
+#endif
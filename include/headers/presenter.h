@@ -0,0 +1,66 @@
+#ifndef PRESENTER_H
+#define PRESENTER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "ppu.h"
+#include "triplebuffer.h"
+
+struct SDL_Window;
+struct SDL_Renderer;
+struct SDL_Texture;
+
+// SDL window showing the framebuffer. The emulation thread hands finished frames to
+// submit() and never waits on the display; run() owns the window on the main thread
+// (SDL wants video there), uploads whatever frame is newest and presents with vsync.
+// A frame the PPU says is unchanged doesn't get copied, uploaded or presented at all.
+// SDL_VIDEO_DRIVER=offscreen or dummy runs the whole thing without a display
+class Presenter {
+    public:
+        using Frame = std::array<uint32_t, PPU::WIDTH * PPU::HEIGHT>;
+
+        struct Stats {
+            uint64_t submitted = 0; // Frames offered by the emulation thread
+            uint64_t unchanged = 0; // Of those, identical to the one before and dropped
+            uint64_t presented = 0; // Uploaded and presented, the rest got overtaken
+        };
+
+        Presenter() = default;
+        ~Presenter();
+        Presenter(const Presenter&) = delete;
+        Presenter& operator=(const Presenter&) = delete;
+
+        // Initialises SDL video and opens the window at an integer scale. False (and the
+        // reason on cerr) if that didn't work
+        bool open(const char* title, int scale);
+
+        // Emulation thread. Copies framebuffer (PPU::framebuffer() layout) into the triple
+        // buffer, unless changed (PPU::framebufferChanged()) says it's the same as last time
+        void submit(const uint32_t* framebuffer, bool changed);
+
+        // Main thread. Handles events and presents until the window is closed or stop()
+        void run();
+        // Any thread
+        void stop() { _running = false; }
+        bool running() const { return _running; }
+
+        // Only exact once run() has returned and submit() won't be called again
+        Stats stats() const { return Stats{ _submitted, _unchanged, _presented }; }
+
+    private:
+        SDL_Window* _window = nullptr;
+        SDL_Renderer* _renderer = nullptr;
+        SDL_Texture* _texture = nullptr;
+
+        TripleBuffer<Frame> _frames;
+        std::atomic<bool> _running{ false };
+
+        uint64_t _submitted = 0; // Emulation thread
+        uint64_t _unchanged = 0;
+        uint64_t _presented = 0; // Main thread
+
+        void present(const Frame& frame);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "linerenderer.h"
+#include "spscring.h"
+
+// Draws scanlines on a worker thread. The emulation thread keeps all the LCD timing
+// and only journals what the renderer needs: every VRAM/OAM/LCD register write, in
+// order, with markers for when each line's mode 3 starts. The worker replays that
+// into its own copy of the bus and draws the line at the marker, so it sees exactly
+// the state the inline renderer would have, just later
+class RenderThread {
+    public:
+        // Starts from mem as it is now and takes over current's picture
+        RenderThread(const uint8_t* mem, const LineRenderer& current);
+        ~RenderThread();
+
+        void write(uint16_t address, uint8_t value) { push(Entry{ WRITE, value, address }); }
+        void startFrame() { pushAndWake(Entry{ START_FRAME, 0, 0 }); }
+        void renderLine(unsigned int ly) { pushAndWake(Entry{ LINE, 0, static_cast<uint16_t>(ly) }); }
+        void clear() { pushAndWake(Entry{ CLEAR, 0, 0 }); }
+        void hashFrame() { pushAndWake(Entry{ HASH, 0, 0 }); }
+
+        // Waits until everything journaled so far has been drawn. The worker has nothing
+        // to do after that, so renderer() and the hashes can be read until the next push
+        void flush();
+        const LineRenderer& renderer() const { return _renderer; }
+        bool takeChanged() { return _renderer.takeChanged(); } // Same, only after a flush
+        // Moves the hashes of frames finished since the last call onto the end of hashes
+        void takeHashes(std::vector<uint64_t>& hashes);
+
+    private:
+        enum Kind : uint8_t { WRITE, START_FRAME, LINE, CLEAR, HASH, SYNC, STOP };
+        struct Entry {
+            Kind kind;
+            uint8_t value;
+            uint16_t address; // Or the line
+        };
+        // A frame of heavy VRAM traffic fits, anything more and the emulation thread waits
+        static const size_t RING_SIZE = 1 << 16;
+
+        // Only VRAM, OAM and the LCD registers are kept up to date. Initialised before
+        // _renderer gets a pointer into it, the constructor copies the bus over it after
+        std::array<uint8_t, 0x10000> _mem{};
+        LineRenderer _renderer;
+        std::vector<uint64_t> _hashes;
+        SpscRing<Entry, RING_SIZE> _ring;
+
+        // Syncs pushed by the emulation thread and done by the worker
+        uint64_t _syncsSent = 0;
+        std::atomic<uint64_t> _syncsDone{ 0 };
+
+        // The worker sleeps here when it runs dry. Only line markers and the like wake it,
+        // single writes would pay for a fence each
+        std::mutex _wakeMutex;
+        std::condition_variable _wake;
+        std::atomic<bool> _sleeping{ false };
+
+        std::thread _thread;
+
+        void push(const Entry& entry);
+        void pushAndWake(const Entry& entry);
+        void wake();
+        void run();
+        void apply(const Entry& entry);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Keeps the next deadline of the timer, PPU and serial port, keyed by absolute M-cycle.
+// They schedule their own next event instead of being ticked, the CPU runs
+// until nextCycle() and then calls run() to fire whatever is due.
+// Each one has at most one pending event, so this is a small indexed min-heap
+// where scheduling again moves the existing entry
+class Scheduler {
+    public:
+        enum class Event : uint8_t { Timer, PPU, Serial, Count };
+        static const size_t EVENT_COUNT = static_cast<size_t>(Event::Count);
+
+        // Gets the cycle the event was scheduled for, which can be a little behind
+        // the CPU since events only fire between instructions
+        using Callback = void (*)(void* context, uint64_t cycle);
+
+        Scheduler();
+
+        void setHandler(Event event, Callback callback, void* context);
+        void schedule(Event event, uint64_t cycle); // Replaces the pending one if there is one
+        void cancel(Event event);
+        bool scheduled(Event event) const { return _position[index(event)] >= 0; }
+        uint64_t when(Event event) const; // UINT64_MAX if not scheduled
+
+        uint64_t nextCycle() const { return _count ? _heap[0].cycle : UINT64_MAX; }
+        // Fires every event due at or before now, earliest first. Callbacks can schedule
+        // again, anything that lands at or before now fires in the same call
+        void run(uint64_t now);
+
+        uint64_t fired() const { return _fired; }
+
+    private:
+        struct Entry {
+            uint64_t cycle;
+            Event event;
+        };
+        struct Handler {
+            Callback callback;
+            void* context;
+        };
+
+        std::array<Entry, EVENT_COUNT> _heap;
+        std::array<int8_t, EVENT_COUNT> _position; // Heap slot of each event, -1 when not scheduled
+        std::array<Handler, EVENT_COUNT> _handlers;
+        size_t _count = 0;
+        uint64_t _fired = 0;
+
+        static size_t index(Event event) { return static_cast<size_t>(event); }
+        // Ties go to the lower event so the order never depends on the heap layout
+        static bool before(const Entry& a, const Entry& b) {
+            return a.cycle < b.cycle || (a.cycle == b.cycle && a.event < b.event);
+        }
+        void place(size_t slot, const Entry& entry);
+        void siftUp(size_t slot);
+        void siftDown(size_t slot);
+        void removeAt(size_t slot);
+};
+
+#endif
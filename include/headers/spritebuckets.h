@@ -0,0 +1,38 @@
+#ifndef SPRITEBUCKETS_H
+#define SPRITEBUCKETS_H
+
+#include <array>
+#include <cstdint>
+
+// Which of the 40 OAM sprites cover each visible line, as a bit per sprite. Only a
+// Y write or a sprite size change can move a sprite between lines, so the sets are
+// patched on those instead of scanning all of OAM for every line drawn
+class SpriteBuckets {
+    public:
+        static const unsigned int SPRITE_COUNT = 40;
+        static const unsigned int LINE_LIMIT = 10; // The DMG draws at most 10 sprites per line
+        static const unsigned int HEIGHT = 144;
+
+        // oam points at 0xFE00
+        explicit SpriteBuckets(const uint8_t* oam);
+
+        // After a write to OAM has landed, address is the full bus address
+        void oamWritten(uint16_t address);
+        // LCDC bit 2, 8 or 16
+        void setHeight(unsigned int height);
+        unsigned int height() const { return _height; }
+
+        // The sprites the DMG would draw on ly, highest priority first: the first 10 in
+        // OAM order, then sorted by X with OAM order breaking ties. Returns the count
+        unsigned int line(unsigned int ly, std::array<uint8_t, LINE_LIMIT>& sprites) const;
+
+    private:
+        const uint8_t* _oam;
+        std::array<uint64_t, HEIGHT> _lines;
+        std::array<uint8_t, SPRITE_COUNT> _y; // The Y each sprite is filed under
+        unsigned int _height = 8;
+
+        void place(unsigned int sprite, bool covered);
+};
+
+#endif
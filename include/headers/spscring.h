@@ -0,0 +1,57 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Fixed size lock-free queue for exactly one producer thread and one consumer thread.
+// Each side keeps a stale copy of the other's index so it only touches the shared
+// cache line when it looks full or empty
+template <typename T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "N has to be a power of two");
+
+    public:
+        // Producer side, false when full
+        bool push(const T& item) {
+            size_t head = _head.load(std::memory_order_relaxed);
+            if (head - _tailCache == N) {
+                _tailCache = _tail.load(std::memory_order_acquire);
+                if (head - _tailCache == N) {
+                    return false;
+                }
+            }
+            _items[head & (N - 1)] = item;
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side, false when empty
+        bool pop(T& item) {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _headCache) {
+                _headCache = _head.load(std::memory_order_acquire);
+                if (tail == _headCache) {
+                    return false;
+                }
+            }
+            item = _items[tail & (N - 1)];
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Either side, only exact when the other one is idle
+        bool empty() const {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        alignas(64) std::atomic<size_t> _head{ 0 }; // Next slot the producer writes
+        size_t _tailCache = 0;                      // Producer's copy of _tail
+        alignas(64) std::atomic<size_t> _tail{ 0 }; // Next slot the consumer reads
+        size_t _headCache = 0;                      // Consumer's copy of _head
+        alignas(64) std::array<T, N> _items;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+struct TileCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0; // Row lookups that had to decode the tile first
+};
+
+// VRAM tiles (0x8000-0x97FF) decoded from the 2bpp bit planes into one colour index
+// per byte. Tiles get drawn far more often than they're written, so a tile is only
+// decoded again after a write dirties it. The DMG has a single VRAM bank, hence 384
+class TileCache {
+    public:
+        static const unsigned int TILE_COUNT = 384;
+
+        // vram points at 0x8000
+        explicit TileCache(const uint8_t* vram);
+
+        // Call for every write to 0x8000-0x97FF
+        void invalidate(uint16_t address) {
+            _dirty.set((address - 0x8000) >> 4);
+        }
+        void invalidateAll() { _dirty.set(); }
+
+        // 8 colour indices, left to right. tile is the index from 0x8000, 0-383
+        const uint8_t* row(unsigned int tile, unsigned int y) {
+            if (_dirty[tile]) {
+                decode(tile);
+                _stats.misses++;
+            } else {
+                _stats.hits++;
+            }
+            return &_tiles[tile][y * 8];
+        }
+
+        const TileCacheStats& stats() const { return _stats; }
+
+    private:
+        const uint8_t* _vram;
+        std::array<std::array<uint8_t, 64>, TILE_COUNT> _tiles;
+        std::bitset<TILE_COUNT> _dirty;
+        TileCacheStats _stats;
+
+        void decode(unsigned int tile);
+};
+
+#endif
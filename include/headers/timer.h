@@ -0,0 +1,50 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <cstdint>
+
+// DIV/TIMA/TMA/TAC (0xFF04-0xFF07) worked out from the cycle counter instead of
+// being ticked. DIV is the top byte of a 16 bit counter running at 4 per M-cycle,
+// and TIMA counts falling edges of one bit of it. Between register writes the
+// whole thing is a function of time, so TIMA only gets brought up to date when
+// someone looks at it and the overflow interrupt is a single scheduled event
+class Timer {
+    public:
+        static const uint64_t NEVER = UINT64_MAX;
+
+        Timer();
+
+        uint8_t read(uint16_t address, uint64_t now) const;
+        // Returns true if an overflow interrupt came due on the way, including the
+        // edge a DIV or TAC write can cause
+        bool write(uint16_t address, uint8_t value, uint64_t now);
+        // Runs TIMA up to now, true if it reloaded from TMA at least once
+        bool catchUp(uint64_t now);
+
+        // Cycle the next overflow interrupt is requested on
+        uint64_t nextInterrupt() const;
+        // First cycle after now the register at address can read differently
+        uint64_t nextChange(uint16_t address, uint64_t now) const;
+
+    private:
+        // The internal counter is counter(now) & 0xFFFF, kept unwrapped so edges can
+        // be counted with a divide
+        uint64_t _counterBase = 0;
+        uint64_t counter(uint64_t now) const { return now * 4 + _counterBase; }
+
+        uint8_t _tima = 0;
+        uint8_t _tma = 0;
+        uint8_t _tac = 0;
+        uint64_t _synced = 0;      // Cycle _tima is correct for
+        uint64_t _reload = NEVER;  // TIMA sits at 0 for an M-cycle after overflowing, then loads TMA
+
+        bool enabled() const { return _tac & 0x04; }
+        // Counter period between TIMA increments, they happen when bit period/2 falls
+        uint64_t period() const;
+        // Cycle of the nth TIMA increment after _synced
+        uint64_t edgeCycle(uint64_t n) const;
+        bool signal(uint64_t now) const { return enabled() && (counter(now) & (period() / 2)); }
+        void increment(uint64_t now); // A glitch edge from a register write
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Latest-value handoff between one producer thread and one consumer thread. The
+// producer fills back() and publishes it, the consumer takes whatever was published
+// last. Neither side ever waits, frames the consumer was too slow for get dropped
+template <typename T>
+class TripleBuffer {
+    public:
+        // Producer side
+        T& back() { return _slots[_back]; }
+        void publish() {
+            _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Consumer side, true if something newer than front() was published and got swapped in
+        bool update() {
+            if (!(_middle.load(std::memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+        const T& front() const { return _slots[_front]; }
+
+    private:
+        // _middle is the slot index of the one in between, plus FRESH if the producer
+        // put it there and the consumer hasn't taken it yet
+        static const uint8_t INDEX = 0x03;
+        static const uint8_t FRESH = 0x04;
+
+        std::array<T, 3> _slots{};
+        uint8_t _back = 0;
+        uint8_t _front = 1;
+        alignas(64) std::atomic<uint8_t> _middle{ 2 };
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <cstdint>
+
+// Index of the lowest set bit, value can't be 0
+inline unsigned int lowestSetBit(uint32_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctz(value);
+#else
+    unsigned int i = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+inline unsigned int lowestSetBit64(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    unsigned int i = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// FNV-1a, folds the low bytes of value in one at a time, lowest first. A byte at a time
+// so every bit of the digest depends on the input
+const uint64_t FNV_OFFSET = 0xCBF29CE484222325;
+inline uint64_t fnv1a(uint64_t hash, uint64_t value, unsigned int bytes) {
+    for (unsigned int i = 0; i < bytes; ++i) {
+        hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 0x100000001B3;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "alu.h"
+
+namespace {
+
+constexpr std::array<uint8_t, 256> makeIncTable() {
+    std::array<uint8_t, 256> table{};
+    for (unsigned int old = 0; old < 256; ++old) {
+        uint8_t result = old + 1;
+        uint8_t f = 0;
+        if (result == 0) f |= 0x80;
+        if ((old & 0x0F) == 0x0F) f |= 0x20;
+        table[old] = f;
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> makeDecTable() {
+    std::array<uint8_t, 256> table{};
+    for (unsigned int old = 0; old < 256; ++old) {
+        uint8_t result = old - 1;
+        uint8_t f = 0x40;
+        if (result == 0) f |= 0x80;
+        if ((old & 0x0F) == 0x00) f |= 0x20;
+        table[old] = f;
+    }
+    return table;
+}
+
+constexpr std::array<uint16_t, 0x800> makeDaaTable() {
+    std::array<uint16_t, 0x800> table{};
+    for (unsigned int i = 0; i < 0x800; ++i) {
+        uint8_t a = i & 0xFF;
+        bool n = i & 0x400, h = i & 0x200, carry = i & 0x100;
+        uint8_t adjustment = 0;
+        if (n) { // After a subtraction only the flags matter
+            if (h) adjustment |= 0x06;
+            if (carry) adjustment |= 0x60;
+            a -= adjustment;
+        } else {
+            if (h || (a & 0x0F) > 0x09) adjustment |= 0x06;
+            if (carry || a > 0x99) {
+                adjustment |= 0x60;
+                carry = true;
+            }
+            a += adjustment;
+        }
+        uint8_t f = n ? 0x40 : 0; // N is kept, H is always cleared
+        if (carry) f |= 0x10;
+        if (a == 0) f |= 0x80;
+        table[i] = (a << 8) | f;
+    }
+    return table;
+}
+
+// 128K entries each is well past clang's default constexpr step limit, so these
+// two get filled in during static initialisation instead
+std::array<uint8_t, 0x20000> makeAddSubTable(bool subtract) {
+    std::array<uint8_t, 0x20000> table{};
+    for (unsigned int i = 0; i < table.size(); ++i) {
+        uint8_t a = (i >> 8) & 0xFF, b = i & 0xFF, carry = i >> 16;
+        uint16_t result = subtract ? a - b - carry : a + b + carry;
+        uint8_t f = subtract ? 0x40 : 0;
+        if ((result & 0xFF) == 0) f |= 0x80;
+        if ((a ^ b ^ result) & 0x10) f |= 0x20;
+        if (result & 0x100) f |= 0x10;
+        table[i] = f;
+    }
+    return table;
+}
+
+}
+
+static_assert(makeIncTable()[0xFF] == 0xA0, "INC 0xFF sets Z and H");
+static_assert(makeDecTable()[0x01] == 0xC0, "DEC 0x01 sets Z and N");
+static_assert(makeDaaTable()[0x09A] == 0x0090, "DAA 0x9A after an add is 0x00 with Z and C");
+
+// Constant initialised, these end up as data in the binary
+const std::array<uint8_t, 256> AluTables::INC = makeIncTable();
+const std::array<uint8_t, 256> AluTables::DEC = makeDecTable();
+const std::array<uint16_t, 0x800> AluTables::DAA = makeDaaTable();
+const std::array<uint8_t, 0x20000> AluTables::ADD = makeAddSubTable(false);
+const std::array<uint8_t, 0x20000> AluTables::SUB = makeAddSubTable(true);
+
+size_t AluTables::bytes() {
+    return sizeof(INC) + sizeof(DEC) + sizeof(ADD) + sizeof(SUB) + sizeof(DAA);
+}
@@ -0,0 +1,717 @@
+#include "bench.h"
+#include "cpu.h"
+#include "alu.h"
+#include "scheduler.h"
+#include "compositor.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <random>
+#include <sstream>
+
+namespace {
+
+std::vector<std::string> benchROMs() {
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator("ROMS")) {
+        if (entry.path().extension() == ".gb") {
+            paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::vector<uint8_t> loadFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), {});
+}
+
+// DMG clock in M-cycles per second
+const double MCYCLES_PER_SECOND = 1048576.0;
+// Longest a timer interrupt can keep HALT waiting, TAC 00 with TMA 0
+const uint64_t MAX_HALT_CYCLES = 256 * 256;
+
+// Runs the ROM for a fixed number of instructions through CPU::execute, returns MIPS.
+// realtime gets the emulated time over host time
+double measureMIPS(const std::vector<uint8_t>& rom, CPU::ExecMode mode, double& realtime) {
+    const unsigned int chunk = 1000000;
+    const uint64_t total = 20000000;
+
+    // The test ROMs print over serial, keep that out of the report
+    std::ostringstream sink;
+    std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+
+    CPU cpu;
+    cpu.setExecMode(mode);
+    cpu.setIdleSkipping(false); // Measure running the code, --bench idle covers skipping it
+    cpu.loadROM(rom);
+    uint64_t instructions = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (instructions < total) {
+        instructions += cpu.execute(chunk);
+        // Let run() skip to the interrupt, whatever it executes on the way isn't counted
+        if (cpu.isHalted() && cpu.run(MAX_HALT_CYCLES) == CPU::RunResult::Halted) {
+            break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout.rdbuf(old);
+    realtime = cpu.cycles() / MCYCLES_PER_SECOND / seconds;
+    return instructions / seconds / 1e6;
+}
+
+// Emulated seconds per ROM with idle loop skipping off and on. The serial output has
+// to come out the same either way
+int benchIdle() {
+    const uint64_t cycles = uint64_t(MCYCLES_PER_SECOND) * 30;
+    std::cout << std::left << std::setw(32) << "30 emulated s" << std::right << std::setw(10) << "off s"
+              << std::setw(10) << "on s" << std::setw(10) << "hits" << std::setw(12) << "skipped %" << "  serial\n";
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        double seconds[2];
+        std::string logs[2];
+        CPU::IdleStats stats;
+        for (int skipping = 0; skipping < 2; ++skipping) {
+            std::ostringstream sink;
+            std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+            CPU cpu;
+            cpu.setIdleSkipping(skipping);
+            cpu.loadROM(rom);
+            auto start = std::chrono::steady_clock::now();
+            cpu.run(cycles);
+            seconds[skipping] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout.rdbuf(old);
+            logs[skipping] = cpu.getLog();
+            stats = cpu.idleStats();
+        }
+        std::cout << std::left << std::setw(32) << path << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << seconds[0] << std::setw(10) << seconds[1] << std::setw(10) << stats.hits
+                  << std::setw(12) << std::setprecision(1) << 100.0 * stats.cycles / cycles
+                  << "  " << (logs[0] == logs[1] ? "same" : "DIFFERENT") << "\n";
+    }
+    return 0;
+}
+
+// Dynamic opcode pairs over every ROM, the data the fusion set in opcodes.cpp comes from
+int benchPairs() {
+    const size_t top = 30;
+    std::vector<uint64_t> totals(0x10000, 0);
+    uint64_t instructions = 0;
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::ostringstream sink;
+        std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+        CPU cpu;
+        cpu.setPairProfiling(true);
+        cpu.loadROM(rom);
+        // Only up to the verdict, after that the ROMs sit in a JR to itself
+        const uint64_t limit = uint64_t(MCYCLES_PER_SECOND) * 120;
+        while (cpu.cycles() < limit && cpu.runUntil(Memory::EVENT_SERIAL, limit - cpu.cycles()) == CPU::RunResult::SerialByte) {
+            if (cpu.getLog().find("Passed") != std::string::npos || cpu.getLog().find("Failed") != std::string::npos) {
+                break;
+            }
+        }
+        std::cout.rdbuf(old);
+        for (const CPU::OpcodePair& pair : cpu.topOpcodePairs(0x10000)) {
+            totals[(pair.first << 8) | pair.second] += pair.count;
+            instructions += pair.count;
+        }
+    }
+
+    std::vector<unsigned int> order(0x10000);
+    for (unsigned int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                      [&](unsigned int a, unsigned int b) { return totals[a] > totals[b]; });
+
+    std::cout << "Top " << top << " opcode pairs, * = fused in the block cache\n";
+    std::cout << std::hex << std::uppercase << std::setfill('0');
+    for (size_t i = 0; i < top && totals[order[i]]; ++i) {
+        unsigned int pair = order[i];
+        std::cout << std::setw(2) << (pair >> 8) << " " << std::setw(2) << (pair & 0xFF)
+                  << (CPU::isFusedPair(pair >> 8, pair & 0xFF) ? " * " : "   ")
+                  << std::dec << std::setfill(' ') << std::fixed << std::setprecision(2)
+                  << std::setw(8) << 100.0 * totals[pair] / instructions << "%\n"
+                  << std::hex << std::setfill('0');
+    }
+    std::cout << std::dec << std::setfill(' ');
+    return 0;
+}
+
+// Every ROM in ROMS/ under each execution mode
+int benchCPU() {
+#ifdef GB_THREADED_DISPATCH
+    std::cout << "Interpreter dispatch: threaded (computed goto)\n";
+#else
+    std::cout << "Interpreter dispatch: handler table\n";
+#endif
+#ifdef GB_LAZY_FLAGS
+    std::cout << "Flags: lazy\n";
+#else
+    std::cout << "Flags: eager\n";
+#endif
+#ifdef GB_JIT_AVAILABLE
+    const CPU::ExecMode modes[] = { CPU::ExecMode::Interpreter, CPU::ExecMode::Cached, CPU::ExecMode::JIT };
+    const char* names[] = { "interp", "cached", "jit" };
+#else
+    const CPU::ExecMode modes[] = { CPU::ExecMode::Interpreter, CPU::ExecMode::Cached };
+    const char* names[] = { "interp", "cached" };
+#endif
+    const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+    std::cout << std::left << std::setw(32) << "MIPS" << std::right;
+    for (size_t m = 0; m < modeCount; ++m) {
+        std::cout << std::setw(10) << names[m];
+    }
+    std::cout << "\n";
+
+    std::vector<double> totals(modeCount, 0.0);
+    std::vector<double> realtimeTotals(modeCount, 0.0);
+    std::vector<std::string> roms = benchROMs();
+    for (const std::string& path : roms) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::cout << std::left << std::setw(32) << path << std::right << std::fixed << std::setprecision(1);
+        for (size_t m = 0; m < modeCount; ++m) {
+            double realtime = 0.0;
+            double mips = measureMIPS(rom, modes[m], realtime);
+            totals[m] += mips;
+            realtimeTotals[m] += realtime;
+            std::cout << std::setw(10) << mips;
+        }
+        std::cout << "\n";
+    }
+    if (!roms.empty()) {
+        std::cout << std::left << std::setw(32) << "mean" << std::right;
+        for (size_t m = 0; m < modeCount; ++m) {
+            std::cout << std::setw(10) << totals[m] / roms.size();
+        }
+        std::cout << "\n" << std::left << std::setw(32) << "mean x realtime" << std::right;
+        for (size_t m = 0; m < modeCount; ++m) {
+            std::cout << std::setw(10) << realtimeTotals[m] / roms.size();
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+
+// The branchy flag code the ALU helpers used before the tables, kept as the reference
+struct BranchyALU {
+    static uint8_t add(uint8_t a, uint8_t b, uint8_t carry, uint8_t& f) {
+        uint16_t result = a + b + carry;
+        f = 0;
+        if ((result & 0xFF) == 0) f |= 0x80;
+        if (((a & 0xF) + (b & 0xF) + carry) > 0xF) f |= 0x20;
+        if (result > 0xFF) f |= 0x10;
+        return result & 0xFF;
+    }
+    static uint8_t sub(uint8_t a, uint8_t b, uint8_t carry, uint8_t& f) {
+        uint16_t result = a - b - carry;
+        f = 0x40;
+        if ((result & 0xFF) == 0) f |= 0x80;
+        if ((a & 0xF) < ((b & 0xF) + carry)) f |= 0x20;
+        if (a < (b + carry)) f |= 0x10;
+        return result & 0xFF;
+    }
+    static uint8_t inc(uint8_t r, uint8_t& f) {
+        uint8_t result = r + 1;
+        f &= 0x10;
+        if ((r & 0x0F) + 1 > 0x0F) f |= 0x20;
+        if (result == 0) f |= 0x80;
+        return result;
+    }
+    static uint8_t dec(uint8_t r, uint8_t& f) {
+        uint8_t result = r - 1;
+        f = (f & 0x10) | 0x40;
+        if ((r & 0x0F) == 0) f |= 0x20;
+        if (result == 0) f |= 0x80;
+        return result;
+    }
+    static uint8_t daa(uint8_t a, uint8_t& f) {
+        uint8_t adjustment = 0;
+        bool carry = f & 0x10;
+        if (f & 0x40) {
+            if (f & 0x20) adjustment |= 0x06;
+            if (carry) adjustment |= 0x60;
+            a -= adjustment;
+        } else {
+            if ((f & 0x20) || (a & 0x0F) > 0x09) adjustment |= 0x06;
+            if (carry || a > 0x99) {
+                adjustment |= 0x60;
+                carry = true;
+            }
+            a += adjustment;
+        }
+        f &= 0x40;
+        if (carry) f |= 0x10;
+        if (a == 0) f |= 0x80;
+        return a;
+    }
+};
+
+struct TableALU {
+    static uint8_t add(uint8_t a, uint8_t b, uint8_t carry, uint8_t& f) {
+        f = AluTables::ADD[AluTables::index(a, b, carry)];
+        return a + b + carry;
+    }
+    static uint8_t sub(uint8_t a, uint8_t b, uint8_t carry, uint8_t& f) {
+        f = AluTables::SUB[AluTables::index(a, b, carry)];
+        return a - b - carry;
+    }
+    static uint8_t inc(uint8_t r, uint8_t& f) {
+        f = (f & 0x10) | AluTables::INC[r];
+        return r + 1;
+    }
+    static uint8_t dec(uint8_t r, uint8_t& f) {
+        f = (f & 0x10) | AluTables::DEC[r];
+        return r - 1;
+    }
+    static uint8_t daa(uint8_t a, uint8_t& f) {
+        uint16_t entry = AluTables::DAA[((f >> 4) & 0x7) << 8 | a];
+        f = entry & 0xFF;
+        return entry >> 8;
+    }
+};
+
+// Every input of every table against the reference
+bool aluTablesMatch() {
+    for (unsigned int i = 0; i < 0x20000; ++i) {
+        uint8_t a = i >> 8, b = i & 0xFF, carry = i >> 16, f1 = 0, f2 = 0;
+        if (BranchyALU::add(a, b, carry, f1) != TableALU::add(a, b, carry, f2) || f1 != f2) return false;
+        if (BranchyALU::sub(a, b, carry, f1) != TableALU::sub(a, b, carry, f2) || f1 != f2) return false;
+    }
+    for (unsigned int i = 0; i < 0x800; ++i) {
+        uint8_t f1 = (i >> 4) & 0x70, f2 = f1;
+        if (BranchyALU::daa(i & 0xFF, f1) != TableALU::daa(i & 0xFF, f2) || f1 != f2) return false;
+        f1 = f2 = (i >> 4) & 0x70;
+        if (BranchyALU::inc(i & 0xFF, f1) != TableALU::inc(i & 0xFF, f2) || f1 != f2) return false;
+        f1 = f2 = (i >> 4) & 0x70;
+        if (BranchyALU::dec(i & 0xFF, f1) != TableALU::dec(i & 0xFF, f2) || f1 != f2) return false;
+    }
+    return true;
+}
+
+// Runs an accumulator through ADD/ADC/SUB/SBC/INC/DAA on random operands, which is
+// the worst case for the branch predictor. Returns ns per operation
+template <typename ALU>
+double measureALU(const std::vector<uint8_t>& operands, uint32_t& checksum) {
+    const unsigned int rounds = 20;
+    uint8_t a = 0, f = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i + 1 < operands.size(); i += 2) {
+            uint8_t b = operands[i];
+            uint8_t carry = (f >> 4) & 1;
+            switch (operands[i + 1] & 7) {
+                case 0: a = ALU::add(a, b, 0, f); break;
+                case 1: a = ALU::add(a, b, carry, f); break;
+                case 2: a = ALU::sub(a, b, 0, f); break;
+                case 3: a = ALU::sub(a, b, carry, f); break;
+                case 4: ALU::sub(a, b, 0, f); break; // CP
+                case 5: a = ALU::inc(a, f); break;
+                case 6: a = ALU::daa(a, f); break;
+                default: a = ALU::add(b, b, 0, f); break;
+            }
+            checksum = checksum * 31 + a + f;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * 1e9 / (double(rounds) * (operands.size() / 2));
+}
+
+int benchALU() {
+    std::vector<uint8_t> operands(1 << 20);
+    std::mt19937 rng(1234);
+    for (uint8_t& b : operands) {
+        b = rng() & 0xFF;
+    }
+
+    uint32_t branchySum = 0, tableSum = 0;
+    double branchy = measureALU<BranchyALU>(operands, branchySum);
+    double table = measureALU<TableALU>(operands, tableSum);
+
+    std::cout << "ALU flag tables: " << AluTables::bytes() / 1024 << " KiB, "
+              << (aluTablesMatch() && branchySum == tableSum ? "bit exact" : "MISMATCH") << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << std::left << std::setw(12) << "branchy" << std::right << std::setw(8) << branchy << " ns/op\n";
+    std::cout << std::left << std::setw(12) << "tables" << std::right << std::setw(8) << table << " ns/op\n";
+    std::cout << "speedup " << branchy / table << "x\n";
+    return 0;
+}
+
+
+// A ROM that runs LD (HL),A / INC A forever with HL = target. Same code for any
+// target, so the MIPS only differ by what the stores cost
+std::vector<uint8_t> storeLoopROM(uint16_t target) {
+    std::vector<uint8_t> rom(0x8000, 0x00);
+    const uint8_t entry[] = { 0x00, 0xC3, 0x50, 0x01 }; // NOP, JP 0x0150
+    const uint8_t loop[] = {
+        0xF3, 0xAF,                                         // DI, XOR A
+        0x21, uint8_t(target & 0xFF), uint8_t(target >> 8), // LD HL, target
+        0x77, 0x3C, 0x77, 0x3C, 0x77,                       // LD (HL),A / INC A ...
+        0x18, 0xF9,                                         // JR back to the first store
+    };
+    std::copy(std::begin(entry), std::end(entry), rom.begin() + 0x100);
+    std::copy(std::begin(loop), std::end(loop), rom.begin() + 0x150);
+    return rom;
+}
+
+// HRAM stores can't move code or a deadline, so they mustn't end a cached block.
+// That holds while the page is watched for a routine cached in HRAM too (the usual
+// OAM DMA one), except on the routine's own bytes
+bool hramWritesQuiet() {
+    Memory mem;
+    uint32_t before = mem.sideEffects();
+    for (unsigned int address = Memory::HRAM_START; address <= Memory::HRAM_END; ++address) {
+        mem.write(address, address & 0xFF);
+    }
+    mem.watchCode(0xFF80, 8);
+    for (unsigned int address = 0xFF88; address <= Memory::HRAM_END; ++address) {
+        mem.write(address, 0);
+    }
+    bool quiet = mem.sideEffects() == before && mem.read(0xFF80) == 0x80 && mem.read(Memory::HRAM_END) == 0;
+    mem.write(0xFF80, 0);
+    return quiet && mem.sideEffects() != before;
+}
+
+// Stores to HRAM against the same loop storing to WRAM, which is always on the fast path
+int benchHRAM() {
+    bool quiet = hramWritesQuiet();
+    std::cout << "HRAM stores " << (quiet ? "don't end blocks" : "END BLOCKS") << "\n";
+#ifdef GB_JIT_AVAILABLE
+    const CPU::ExecMode modes[] = { CPU::ExecMode::Interpreter, CPU::ExecMode::Cached, CPU::ExecMode::JIT };
+    const char* names[] = { "interp", "cached", "jit" };
+#else
+    const CPU::ExecMode modes[] = { CPU::ExecMode::Interpreter, CPU::ExecMode::Cached };
+    const char* names[] = { "interp", "cached" };
+#endif
+    std::cout << std::left << std::setw(12) << "MIPS" << std::right << std::setw(10) << "WRAM"
+              << std::setw(10) << "HRAM" << "\n" << std::fixed << std::setprecision(1);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        double realtime = 0.0;
+        double wram = measureMIPS(storeLoopROM(0xC000), modes[m], realtime);
+        double hram = measureMIPS(storeLoopROM(0xFF80), modes[m], realtime);
+        std::cout << std::left << std::setw(12) << names[m] << std::right << std::setw(10) << wram
+                  << std::setw(10) << hram << "\n";
+    }
+    return quiet ? 0 : 1;
+}
+
+// Frames drawn per host second with the CPU in its default mode, plus how well the
+// decoded tile cache does. Blargg's ROMs only print text, so few tiles ever change
+int benchPPU() {
+    const uint64_t cycles = uint64_t(MCYCLES_PER_SECOND) * 10;
+    std::cout << std::left << std::setw(32) << "10 emulated s" << std::right << std::setw(10) << "frames"
+              << std::setw(10) << "fps" << std::setw(14) << "tile hits %" << std::setw(10) << "misses" << "\n";
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::ostringstream sink;
+        std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+        CPU cpu;
+        cpu.loadROM(rom);
+        auto start = std::chrono::steady_clock::now();
+        cpu.run(cycles);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout.rdbuf(old);
+
+        const TileCacheStats& stats = cpu.ppu().tileCacheStats();
+        uint64_t lookups = stats.hits + stats.misses;
+        std::cout << std::left << std::setw(32) << path << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << cpu.ppu().frames() << std::setw(10) << cpu.ppu().frames() / seconds
+                  << std::setw(14) << std::setprecision(3) << (lookups ? 100.0 * stats.hits / lookups : 0.0)
+                  << std::setw(10) << stats.misses << "\n";
+    }
+    return 0;
+}
+
+// The same ROMs with the renderer inline and on its own thread. Every frame's hash
+// has to match, then it's frames per host second for each
+int benchRenderThread() {
+    const uint64_t cycles = uint64_t(MCYCLES_PER_SECOND) * 10;
+    std::cout << std::left << std::setw(32) << "10 emulated s" << std::right << std::setw(10) << "frames"
+              << std::setw(12) << "inline fps" << std::setw(12) << "thread fps" << "\n";
+    bool allMatch = true;
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::vector<uint64_t> hashes[2];
+        double seconds[2];
+        for (int threaded = 0; threaded < 2; ++threaded) {
+            std::ostringstream sink;
+            std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+            CPU cpu;
+            cpu.ppu().setRenderThread(threaded);
+            cpu.ppu().setFrameHashing(true);
+            cpu.loadROM(rom);
+            auto start = std::chrono::steady_clock::now();
+            cpu.run(cycles);
+            hashes[threaded] = cpu.ppu().frameHashes(); // Waits for the last frame
+            seconds[threaded] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout.rdbuf(old);
+        }
+        bool match = hashes[0] == hashes[1];
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(32) << path << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << hashes[0].size() << std::setw(12) << hashes[0].size() / seconds[0]
+                  << std::setw(12) << hashes[1].size() / seconds[1] << "   " << (match ? "identical" : "MISMATCH") << "\n";
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Frame hash regression. Every frame of 20 emulated seconds goes into one digest per
+// ROM, checked against ROMS/frame_hashes.txt when it's there. Both renderers have to
+// produce the same list, run it once in the default build and once with -DGB_PIXEL_FIFO.
+// To refresh the list: Main --bench framehash > ROMS/frame_hashes.txt
+int benchFrameHash() {
+    const uint64_t cycles = uint64_t(MCYCLES_PER_SECOND) * 20;
+    std::map<std::string, std::string> expected;
+    std::ifstream list("ROMS/frame_hashes.txt");
+    std::string digest, name;
+    while (list >> digest && std::getline(list >> std::ws, name)) {
+        expected[name] = digest;
+    }
+
+    bool allMatch = true;
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::ostringstream sink;
+        std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+        CPU cpu;
+        cpu.ppu().setFrameHashing(true);
+        cpu.loadROM(rom);
+        cpu.run(cycles);
+        uint64_t hash = FNV_OFFSET;
+        for (uint64_t frame : cpu.ppu().frameHashes()) {
+            hash = fnv1a(hash, frame, 8);
+        }
+        std::cout.rdbuf(old);
+
+        std::ostringstream hex;
+        hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+        std::string romName = std::filesystem::path(path).filename().string();
+        std::cout << hex.str() << " " << romName << "\n";
+        auto it = expected.find(romName);
+        if (it != expected.end() && it->second != hex.str()) {
+            std::cerr << romName << ": expected " << it->second << "\n";
+            allMatch = false;
+        }
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Frames per host second under each draw policy. Skipping frames mustn't change what
+// the ROM sees, so the serial output and frame count have to match drawing every frame
+int benchFrameSkip() {
+    struct Policy {
+        const char* name;
+        PPU::DrawPolicy policy;
+        unsigned int n;
+    };
+    const Policy policies[] = {
+        { "every", PPU::DrawPolicy::EveryFrame, 1 },
+        { "every 4th", PPU::DrawPolicy::EveryNth, 4 },
+        { "1/s asked", PPU::DrawPolicy::OnRequest, 1 },
+        { "never", PPU::DrawPolicy::Never, 1 },
+    };
+    const unsigned int seconds = 10;
+
+    std::cout << std::left << std::setw(32) << "fps, 10 emulated s" << std::right;
+    for (const Policy& policy : policies) {
+        std::cout << std::setw(12) << policy.name;
+    }
+    std::cout << "\n";
+    bool allMatch = true;
+    for (const std::string& path : benchROMs()) {
+        std::vector<uint8_t> rom = loadFile(path);
+        std::cout << std::left << std::setw(32) << path << std::right << std::fixed << std::setprecision(1);
+        std::string firstLog;
+        uint64_t firstFrames = 0;
+        bool match = true;
+        for (const Policy& policy : policies) {
+            std::ostringstream sink;
+            std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+            CPU cpu;
+            cpu.ppu().setDrawPolicy(policy.policy, policy.n);
+            cpu.loadROM(rom);
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int second = 0; second < seconds; ++second) {
+                cpu.ppu().requestFrame(); // Only OnRequest looks at it
+                cpu.run(uint64_t(MCYCLES_PER_SECOND));
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout.rdbuf(old);
+
+            if (&policy == policies) {
+                firstLog = cpu.getLog();
+                firstFrames = cpu.ppu().frames();
+            } else {
+                match = match && cpu.getLog() == firstLog && cpu.ppu().frames() == firstFrames;
+            }
+            std::cout << std::setw(12) << cpu.ppu().frames() / elapsed;
+        }
+        allMatch = allMatch && match;
+        std::cout << "   " << (match ? "same run" : "MISMATCH") << "\n";
+    }
+    return allMatch ? 0 : 1;
+}
+
+// Synthetic load on the scheduler's real event slots: every one reschedules itself at
+// random intervals instead of doing what the timer, PPU or serial port would. Time
+// jumps straight to the next deadline the way HALT does, so this is purely the heap
+struct SchedulerLoad {
+    Scheduler* scheduler;
+    uint32_t seed; // LCG, anything heavier shows up in the numbers
+    Scheduler::Event event;
+    uint64_t checksum;
+};
+
+void rescheduleRandom(void* context, uint64_t cycle) {
+    SchedulerLoad& load = *static_cast<SchedulerLoad*>(context);
+    load.checksum = load.checksum * 31 + cycle;
+    load.seed = load.seed * 1664525 + 1013904223;
+    load.scheduler->schedule(load.event, cycle + 1 + (load.seed >> 22));
+}
+
+int benchScheduler() {
+    const uint64_t events = 20000000;
+    std::cout << std::left << std::setw(12) << "events" << std::right << std::setw(14) << "ns/event"
+              << std::setw(18) << "ns/reschedule" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (size_t pending = 1; pending <= Scheduler::EVENT_COUNT; ++pending) {
+        Scheduler scheduler;
+        std::mt19937 rng(1234);
+        std::vector<SchedulerLoad> loads(pending);
+        for (size_t i = 0; i < pending; ++i) {
+            Scheduler::Event event = static_cast<Scheduler::Event>(i);
+            loads[i] = SchedulerLoad{ &scheduler, static_cast<uint32_t>(rng()), event, 0 };
+            scheduler.setHandler(event, rescheduleRandom, &loads[i]);
+            scheduler.schedule(event, rng() & 0x3FF);
+        }
+
+        // Fire and reschedule from the callback
+        auto start = std::chrono::steady_clock::now();
+        while (scheduler.fired() < events) {
+            scheduler.run(scheduler.nextCycle());
+        }
+        double fire = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Move pending events around without firing them, e.g. a TAC write
+        start = std::chrono::steady_clock::now();
+        uint64_t base = scheduler.nextCycle();
+        uint32_t seed = rng();
+        for (uint64_t i = 0; i < events; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            scheduler.schedule(static_cast<Scheduler::Event>(i % pending), base + (seed >> 22));
+        }
+        double move = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t checksum = scheduler.nextCycle();
+        for (const SchedulerLoad& load : loads) {
+            checksum += load.checksum;
+        }
+        std::cout << std::left << std::setw(12) << pending << std::right << std::setw(14) << fire * 1e9 / events
+                  << std::setw(18) << move * 1e9 / events << "   (" << (checksum & 0xFFFF) << ")\n";
+    }
+    return 0;
+}
+
+// Random lines with about a quarter of the pixels covered by sprites. Every path
+// has to give the same pixels as the scalar one on all of them before it gets timed
+int benchCompositor() {
+    const size_t lineCount = 4096;
+    const unsigned int rounds = 500;
+    std::mt19937 rng(1234);
+    std::vector<LineLayers> lines(lineCount);
+    std::vector<Compositor::Palettes> palettes(lineCount);
+    for (size_t i = 0; i < lineCount; ++i) {
+        for (unsigned int x = 0; x < LineLayers::WIDTH; ++x) {
+            uint32_t r = rng();
+            lines[i].bg[x] = r & 0x03;
+            lines[i].obj[x] = (r >> 2) & 0x03 ? 0 : (r >> 4) & 0x03;
+            lines[i].attr[x] = (r >> 6) & 0x03;
+        }
+        uint32_t r = rng();
+        palettes[i] = Compositor::Palettes{ static_cast<uint8_t>(r), static_cast<uint8_t>(r >> 8), static_cast<uint8_t>(r >> 16) };
+    }
+
+    std::vector<uint32_t> expected(lineCount * LineLayers::WIDTH), out(lineCount * LineLayers::WIDTH);
+    for (size_t i = 0; i < lineCount; ++i) {
+        Compositor::compose(Compositor::Path::Scalar, lines[i], palettes[i], &expected[i * LineLayers::WIDTH]);
+    }
+
+    std::cout << std::left << std::setw(12) << "path" << std::right << std::setw(12) << "ns/line"
+              << std::setw(12) << "Mpixel/s" << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (Compositor::Path path : { Compositor::Path::Scalar, Compositor::Path::SSE2, Compositor::Path::AVX2 }) {
+        if (!Compositor::available(path)) {
+            std::cout << std::left << std::setw(12) << Compositor::name(path) << "not available\n";
+            continue;
+        }
+        for (size_t i = 0; i < lineCount; ++i) {
+            Compositor::compose(path, lines[i], palettes[i], &out[i * LineLayers::WIDTH]);
+        }
+        bool exact = out == expected;
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < lineCount; ++i) {
+                Compositor::compose(path, lines[i], palettes[i], &out[i * LineLayers::WIDTH]);
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double composed = double(rounds) * lineCount;
+        std::cout << std::left << std::setw(12) << Compositor::name(path) << std::right
+                  << std::setw(12) << seconds * 1e9 / composed
+                  << std::setw(12) << composed * LineLayers::WIDTH / seconds / 1e6
+                  << "   " << (exact ? "bit exact" : "MISMATCH") << (path == Compositor::best() ? ", default" : "") << "\n";
+        if (!exact) {
+            return 1;
+        }
+    }
+    return 0;
+}
+}
+
+int runBenchmark(const std::string& name) {
+    if (name == "cpu") {
+        return benchCPU();
+    }
+    if (name == "alu") {
+        return benchALU();
+    }
+    if (name == "pairs") {
+        return benchPairs();
+    }
+    if (name == "hram") {
+        return benchHRAM();
+    }
+    if (name == "idle") {
+        return benchIdle();
+    }
+    if (name == "scheduler") {
+        return benchScheduler();
+    }
+    if (name == "ppu") {
+        return benchPPU();
+    }
+    if (name == "framehash") {
+        return benchFrameHash();
+    }
+    if (name == "frameskip") {
+        return benchFrameSkip();
+    }
+    if (name == "render-thread") {
+        return benchRenderThread();
+    }
+    if (name == "compositor") {
+        return benchCompositor();
+    }
+    std::cerr << "Unknown benchmark: " << name << "\n";
+    return 1;
+}
@@ -0,0 +1,326 @@
+#include "cpu.h"
+#include <algorithm>
+
+namespace {
+
+// Instructions after which execution can't simply fall through to the next one:
+// jumps, calls, returns, HALT/STOP, the IME changes and the unused opcodes
+constexpr bool endsBlock(uint8_t opcode) {
+    uint8_t x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7;
+    if (x == 0) return z == 0 && y >= 2; // STOP, JR
+    if (x == 1) return opcode == 0x76;   // HALT
+    if (x == 2) return false;
+    switch (z) {
+        case 0: return y < 4;                   // RET cc
+        case 1: return y & 1;                   // RET, RETI, JP (HL), LD SP,HL
+        case 2: return y < 4;                   // JP cc
+        case 3: return y != 1;                  // JP, DI, EI, unused
+        case 4: return true;                    // CALL cc, unused
+        case 5: return y & 1;                   // CALL, unused
+        case 6: return false;
+        default: return true;                   // RST
+    }
+}
+
+// Instructions that can sit in a polling loop: no memory writes, no stack, no IME or
+// HALT/STOP changes. Reads are fine, a loop that reads the same addresses with the
+// same registers sees the same values until the hardware changes something
+constexpr bool idleSafe(uint8_t opcode, uint8_t operand) {
+    uint8_t x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7;
+    if (x == 0) {
+        switch (z) {
+            case 0: return y != 1 && y != 2;        // Not LD (a16),SP or STOP
+            case 2: return y & 1;                   // Loads into A only
+            case 3: return (y >> 1) != 3;           // Not INC/DEC SP, SP isn't compared
+            case 4: case 5: case 6: return y != 6;  // Not on (HL)
+            default: return true;
+        }
+    }
+    if (x == 1) return y != 6;                      // LD (HL),r and HALT write/stop
+    if (x == 2) return true;
+    switch (z) {
+        case 0: return y == 6 || y == 7;            // LDH A,(a8), LD HL,SP+r8
+        case 1: return y == 7;                      // LD SP,HL
+        case 2: return y < 4 || y == 6 || y == 7;   // JP cc, LD A,(C), LD A,(a16)
+        case 3:
+            if (y == 0) return true;                // JP
+            if (y == 1) return (operand & 7) != 6 || (operand >> 6) == 1; // CB on a register, or BIT n,(HL)
+            return false;
+        case 6: return true;
+        default: return false;
+    }
+}
+
+// Where a JR/JP (conditional or not) at the end of a block goes, -1 for anything else
+int jumpTarget(uint8_t opcode, uint16_t operand, uint16_t nextPC) {
+    if (opcode == 0x18 || (opcode & 0xE7) == 0x20) {
+        return static_cast<uint16_t>(nextPC + static_cast<int8_t>(operand & 0xFF));
+    }
+    if (opcode == 0xC3 || (opcode & 0xE7) == 0xC2) {
+        return operand;
+    }
+    return -1;
+}
+
+}
+
+CPU::Block* CPU::fetchBlock() {
+    uint32_t key = _mem.codeKey(_PC);
+    uint32_t generation = _mem.pageGeneration(_PC);
+
+    // Direct mapped slots in front of the map catch the hot loops
+    BlockSlot& slot = _blockSlots[key & (BLOCK_SLOTS - 1)];
+    Block* block = slot.key == key ? slot.block : nullptr;
+    if (!block) {
+        block = &_blocks[key];
+        if (block->ops.empty()) {
+            block->generation = generation - 1; // Not compiled yet
+        }
+        slot.key = key;
+        slot.block = block;
+    }
+    if (block->generation != generation) {
+        compileBlock(*block);
+    }
+    // Empty when the first instruction straddles a page boundary
+    return block->ops.empty() ? nullptr : block;
+}
+
+void CPU::compileBlock(Block& block) {
+    block.ops.clear();
+    block.next = nullptr;
+    block.start = _PC;
+    block.hits = 0;
+    block.native = nullptr;
+    block.idle = false;
+    block.generation = _mem.pageGeneration(_PC);
+
+    // Blocks never leave the page they start in, so one page generation covers them
+    uint16_t pc = _PC;
+    unsigned int page = pc >> Memory::PAGE_SHIFT;
+    while (block.ops.size() < MAX_BLOCK_OPS) {
+        uint8_t opcode = _mem.read(pc);
+        uint8_t length = _opLength[opcode];
+        if (((pc + length - 1u) >> Memory::PAGE_SHIFT) != page) {
+            break;
+        }
+
+        DecodedOp op;
+        op.handler = _opTable[opcode];
+        op.length = length;
+        op.opcode = opcode;
+        op.operand = 0;
+        if (length == 2) {
+            op.operand = _mem.read(pc + 1);
+        } else if (length == 3) {
+            op.operand = _mem.read(pc + 1) | (_mem.read(pc + 2) << 8);
+        }
+        if (opcode == 0xCB) {
+            op.handler = _cbTable[op.operand]; // Skip the prefix dispatch
+        }
+        block.ops.push_back(op);
+
+        pc += length;
+        if (endsBlock(opcode)) {
+            break;
+        }
+    }
+
+    block.instructions = block.ops.size();
+    if (block.ops.empty()) {
+        return;
+    }
+    _mem.watchCode(_PC, pc - _PC);
+
+    // A short loop back to its own start that can only read is a polling loop candidate
+    if (block.ops.size() <= MAX_IDLE_OPS && jumpTarget(block.ops.back().opcode, block.ops.back().operand, pc) == block.start) {
+        block.idle = true;
+        for (const DecodedOp& op : block.ops) {
+            block.idle = block.idle && idleSafe(op.opcode, op.operand & 0xFF);
+        }
+    }
+
+    fuseBlock(block);
+}
+
+void CPU::fuseBlock(Block& block) {
+    std::vector<DecodedOp> fused;
+    fused.reserve(block.ops.size());
+    for (size_t i = 0; i < block.ops.size(); ) {
+        const Fusion* match = nullptr;
+        for (const Fusion& fusion : _fusions) {
+            if (i + fusion.count > block.ops.size()) {
+                continue;
+            }
+            bool same = true;
+            for (unsigned int k = 0; k < fusion.count && same; ++k) {
+                // CB ops have their handler resolved already, never fuse those
+                same = block.ops[i + k].opcode == fusion.opcodes[k] && block.ops[i + k].opcode != 0xCB;
+            }
+            if (same) {
+                match = &fusion;
+                break;
+            }
+        }
+        if (!match) {
+            fused.push_back(block.ops[i++]);
+            continue;
+        }
+
+        // Operand bytes go in back to back, the way the fused handler takes them apart
+        DecodedOp op = block.ops[i];
+        op.handler = match->handler;
+        op.count = match->count;
+        op.length = 0;
+        op.operand = 0;
+        unsigned int shift = 0;
+        for (unsigned int k = 0; k < match->count; ++k) {
+            const DecodedOp& part = block.ops[i + k];
+            op.operand |= part.operand << shift;
+            shift += 8 * (part.length - 1);
+            op.length += part.length;
+        }
+        fused.push_back(op);
+        i += match->count;
+    }
+    block.ops.swap(fused);
+}
+
+unsigned int CPU::executeCached(unsigned int count) {
+    Block* previous = nullptr;
+    while (count) {
+        if (_halted) {
+            step(); // Wake-up rules live in one place
+            return count - 1;
+        }
+        if (_mem.dispatchableInterrupts()) {
+            serviceInterrupt();
+            --count;
+            continue;
+        }
+
+        // Any slow path write (IO, MBC, a write into cached code) may change what the
+        // next block is or invalidate the rest of this one
+        uint32_t sideEffects = _mem.sideEffects();
+
+        // Follow the link left by the previous block if nothing could have moved the code since
+        Block* block;
+        if (previous && previous->next && previous->nextPC == _PC && previous->nextSideEffects == sideEffects) {
+            block = previous->next;
+        } else {
+            block = fetchBlock();
+            if (!block) {
+                // Instruction straddles a page boundary
+                previous = nullptr;
+                step();
+                --count;
+                continue;
+            }
+            if (previous) {
+                previous->next = block;
+                previous->nextPC = _PC;
+                previous->nextSideEffects = sideEffects;
+            }
+        }
+        previous = block;
+
+        // Registers going into a polling loop, if the pass leaves them alone it will
+        // keep doing nothing until the hardware changes what it reads
+        bool idle = block->idle && _idleSkipping;
+        uint64_t idleState = idle ? registerState() : 0;
+        uint64_t idleCycles = _cycles;
+        if (idle) {
+            _mem.resetReadHorizon();
+        }
+
+        if (block->native && count >= block->instructions) {
+            count -= block->native(this);
+            if (_imeScheduled) {
+                setIME(true);
+                _imeScheduled = false;
+            }
+            if (_mem.stop || _halted) {
+                return count;
+            }
+            if (idle && _PC == block->start && registerState() == idleState) {
+                skipIdle(*block, _cycles - idleCycles, count);
+            }
+            continue;
+        }
+        if (_execMode == ExecMode::JIT && !block->native && ++block->hits == JIT_THRESHOLD) {
+            translate(*block);
+        }
+
+        size_t executed = 0;
+        for (const DecodedOp& op : block->ops) {
+            if (op.count > count) {
+                // A fused op would run past the budget, finish one at a time
+                step();
+                --count;
+                break;
+            }
+            _PC += op.length;
+            _operand = op.operand;
+            op.handler(*this);
+            count -= op.count;
+            ++executed;
+
+            if (_imeScheduled) {
+                setIME(true);
+                _imeScheduled = false;
+            }
+            if (_mem.stop || _halted) {
+                return count; // Same place the step loop stops
+            }
+            if (count == 0 || _mem.sideEffects() != sideEffects) {
+                break;
+            }
+        }
+        if (idle && executed == block->ops.size() && _PC == block->start && registerState() == idleState) {
+            skipIdle(*block, _cycles - idleCycles, count);
+        }
+    }
+    return 0;
+}
+
+// SP is left out, idleSafe only lets through instructions that set it the same way every pass
+uint64_t CPU::registerState() const {
+    return (uint64_t(getAF()) << 48) | (uint64_t(getBC()) << 32) | (uint64_t(getDE()) << 16) | getHL();
+}
+
+void CPU::skipIdle(const Block& block, uint64_t cyclesPerPass, unsigned int& count) {
+    // A pending interrupt would break out of the loop
+    if (cyclesPerPass == 0 || _mem.dispatchableInterrupts()) {
+        return;
+    }
+    // Whole passes only, so the skipped time lines up exactly with running them
+    uint64_t passes = count / block.instructions;
+    uint64_t next = std::min(_mem.nextEventCycle(), _mem.readHorizon());
+    if (next != UINT64_MAX) {
+        passes = next > _cycles ? std::min<uint64_t>(passes, (next - _cycles) / cyclesPerPass) : 0;
+    }
+    if (passes == 0) {
+        return;
+    }
+    _cycles += passes * cyclesPerPass;
+    count -= passes * block.instructions;
+    _idleStats.hits++;
+    _idleStats.cycles += passes * cyclesPerPass;
+}
+
+void CPU::setIdleSkipping(bool enabled) {
+    _idleSkipping = enabled;
+}
+
+void CPU::translate(Block& block) {
+    if (compileNative(block)) {
+        return;
+    }
+    // Arena is full, start over with only this block
+    _jit.reset();
+    for (auto& entry : _blocks) {
+        entry.second.native = nullptr;
+        entry.second.hits = 0;
+    }
+    compileNative(block);
+}
@@ -0,0 +1,177 @@
+#include "cartridge.h"
+#include <iostream>
+#include <algorithm>
+
+Cartridge::Cartridge() {
+    load(std::vector<uint8_t>());
+}
+
+void Cartridge::load(const std::vector<uint8_t>& rom) {
+    uint8_t type = rom.size() > 0x0147 ? rom[0x0147] : 0x00;
+    uint8_t ramSize = rom.size() > 0x0149 ? rom[0x0149] : 0x00;
+
+    _hasRTC = false;
+    switch (type) {
+        case 0x00: case 0x08: case 0x09:
+            _mbc = MBC::None;
+            break;
+        case 0x01: case 0x02: case 0x03:
+            _mbc = MBC::MBC1;
+            break;
+        case 0x0F: case 0x10:
+            _hasRTC = true;
+            _mbc = MBC::MBC3;
+            break;
+        case 0x11: case 0x12: case 0x13:
+            _mbc = MBC::MBC3;
+            break;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+            _mbc = MBC::MBC5;
+            break;
+        default:
+            std::cerr << "Unsupported cartridge type: 0x" << std::hex << (int)type << std::dec << ", treating as ROM only\n";
+            _mbc = MBC::None;
+            break;
+    }
+
+    size_t romSize = std::min(rom.size(), MAX_ROM_SIZE);
+    if (rom.size() > MAX_ROM_SIZE) {
+        std::cerr << "ROM is larger than " << MAX_ROM_SIZE << " bytes, truncating\n";
+    }
+    // Round up to a power of two number of banks so bank numbers can be masked
+    _romBankCount = 2;
+    while (_romBankCount * ROM_BANK_SIZE < romSize) {
+        _romBankCount *= 2;
+    }
+    _rom.assign(_romBankCount * ROM_BANK_SIZE, 0xFF);
+    std::copy(rom.begin(), rom.begin() + romSize, _rom.begin());
+
+    switch (ramSize) {
+        case 0x01: _ramBankCount = 1; break; // Only 2 KiB of it, see below
+        case 0x02: _ramBankCount = 1; break;
+        case 0x03: _ramBankCount = 4; break;
+        case 0x04: _ramBankCount = 16; break;
+        case 0x05: _ramBankCount = 8; break;
+        default: _ramBankCount = 0; break;
+    }
+    _ram.assign(ramSize == 0x01 ? SMALL_RAM_SIZE : _ramBankCount * RAM_BANK_SIZE, 0x00);
+
+    _ramEnabled = false;
+    _romBankReg = 1;
+    _bankReg2 = 0;
+    _bankMode = 0;
+    _latchReg = 0xFF;
+    _rtc.fill(0);
+    updateBanks();
+}
+
+bool Cartridge::writeRegister(uint16_t address, uint8_t value) {
+    switch (_mbc) {
+        case MBC::None:
+            return false;
+        case MBC::MBC1:
+            if (address < 0x2000) {
+                _ramEnabled = (value & 0x0F) == 0x0A;
+            } else if (address < 0x4000) {
+                _romBankReg = value & 0x1F;
+            } else if (address < 0x6000) {
+                _bankReg2 = value & 0x03;
+            } else {
+                _bankMode = value & 0x01;
+            }
+            break;
+        case MBC::MBC3:
+            if (address < 0x2000) {
+                _ramEnabled = (value & 0x0F) == 0x0A;
+            } else if (address < 0x4000) {
+                _romBankReg = value & 0x7F;
+            } else if (address < 0x6000) {
+                _bankReg2 = value & 0x0F;
+            } else {
+                // Latching copies the clock into the registers, the clock itself isn't running
+                _latchReg = value;
+            }
+            break;
+        case MBC::MBC5:
+            if (address < 0x2000) {
+                _ramEnabled = (value & 0x0F) == 0x0A;
+            } else if (address < 0x3000) {
+                _romBankReg = (_romBankReg & 0x100) | value;
+            } else if (address < 0x4000) {
+                _romBankReg = (_romBankReg & 0xFF) | ((value & 0x01) << 8);
+            } else if (address < 0x6000) {
+                _bankReg2 = value & 0x0F;
+            }
+            break;
+    }
+    return updateBanks();
+}
+
+bool Cartridge::updateBanks() {
+    unsigned int bank0 = 0;
+    unsigned int bankN = 1;
+    unsigned int ramBank = 0;
+
+    switch (_mbc) {
+        case MBC::None:
+            break;
+        case MBC::MBC1:
+            bankN = _romBankReg == 0 ? 1 : _romBankReg;
+            bankN |= _bankReg2 << 5;
+            if (_bankMode) {
+                bank0 = _bankReg2 << 5;
+                ramBank = _bankReg2;
+            }
+            break;
+        case MBC::MBC3:
+            bankN = _romBankReg == 0 ? 1 : _romBankReg;
+            ramBank = _bankReg2;
+            break;
+        case MBC::MBC5:
+            bankN = _romBankReg;
+            ramBank = _bankReg2;
+            break;
+    }
+    bank0 &= _romBankCount - 1;
+    bankN &= _romBankCount - 1;
+
+    uint8_t* ram = nullptr;
+    bool ramAccessible = _ramEnabled || _mbc == MBC::None;
+    _ramOpen = ramAccessible && _ramBankCount > 0 && !(_mbc == MBC::MBC3 && ramBank >= 0x08);
+    // 2 KiB repeats across the 8 KiB window, that one stays on readRAM/writeRAM
+    if (_ramOpen && _ram.size() >= RAM_BANK_SIZE) {
+        ram = &_ram[(ramBank % _ramBankCount) * RAM_BANK_SIZE];
+    }
+
+    const uint8_t* newBank0 = &_rom[bank0 * ROM_BANK_SIZE];
+    const uint8_t* newBankN = &_rom[bankN * ROM_BANK_SIZE];
+    bool changed = newBank0 != _romBank0 || newBankN != _romBankN || ram != _ramBankPtr;
+
+    _romBank0Index = bank0;
+    _romBankNIndex = bankN;
+    _ramBankIndex = _ramBankCount > 0 ? ramBank % _ramBankCount : 0;
+    _romBank0 = newBank0;
+    _romBankN = newBankN;
+    _ramBankPtr = ram;
+    return changed;
+}
+
+uint8_t Cartridge::readRAM(uint16_t address) const {
+    if (_mbc == MBC::MBC3 && _ramEnabled && _hasRTC && _bankReg2 >= 0x08 && _bankReg2 <= 0x0C) {
+        return _rtc[_bankReg2 - 0x08];
+    }
+    if (_ramOpen) {
+        return _ram[(address - 0xA000) % _ram.size()];
+    }
+    return 0xFF; // Open bus, RAM disabled or missing
+}
+
+void Cartridge::writeRAM(uint16_t address, uint8_t value) {
+    if (_mbc == MBC::MBC3 && _ramEnabled && _hasRTC && _bankReg2 >= 0x08 && _bankReg2 <= 0x0C) {
+        _rtc[_bankReg2 - 0x08] = value;
+        return;
+    }
+    if (_ramOpen) {
+        _ram[(address - 0xA000) % _ram.size()] = value;
+    }
+}
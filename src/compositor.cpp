@@ -0,0 +1,177 @@
+#include "compositor.h"
+
+#ifdef GB_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef GB_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+const std::array<uint32_t, 4> Compositor::SHADES = { 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF };
+
+namespace {
+
+uint8_t shadeOf(uint8_t palette, uint8_t index) {
+    return (palette >> (index * 2)) & 0x03;
+}
+
+}
+
+void Compositor::compose(const LineLayers& layers, Palettes palettes, uint32_t* out) {
+    static const Path path = best();
+    compose(path, layers, palettes, out);
+}
+
+void Compositor::compose(Path path, const LineLayers& layers, Palettes palettes, uint32_t* out) {
+    switch (path) {
+#ifdef GB_SIMD_AVX2
+        case Path::AVX2:
+            composeAVX2(layers, palettes, out);
+            return;
+#endif
+#ifdef GB_SIMD_SSE2
+        case Path::SSE2:
+            composeSSE2(layers, palettes, out);
+            return;
+#endif
+        default:
+            composeScalar(layers, palettes, out);
+            return;
+    }
+}
+
+Compositor::Path Compositor::best() {
+    if (available(Path::AVX2)) return Path::AVX2;
+    if (available(Path::SSE2)) return Path::SSE2;
+    return Path::Scalar;
+}
+
+bool Compositor::available(Path path) {
+    switch (path) {
+        case Path::AVX2:
+#ifdef GB_SIMD_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        case Path::SSE2:
+#ifdef GB_SIMD_SSE2
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return true;
+    }
+}
+
+const char* Compositor::name(Path path) {
+    switch (path) {
+        case Path::AVX2: return "avx2";
+        case Path::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void Compositor::composeScalar(const LineLayers& layers, Palettes palettes, uint32_t* out) {
+    for (unsigned int x = 0; x < LineLayers::WIDTH; ++x) {
+        uint8_t obj = layers.obj[x], attr = layers.attr[x], bg = layers.bg[x];
+        if (obj && !((attr & OBJ_BEHIND_BG) && bg)) {
+            out[x] = SHADES[shadeOf((attr & OBJ_PALETTE1) ? palettes.obp1 : palettes.obp0, obj)];
+        } else {
+            out[x] = SHADES[shadeOf(palettes.bgp, bg)];
+        }
+    }
+}
+
+#ifdef GB_SIMD_SSE2
+// No byte shuffle in SSE2, so the palette lookup is a compare per colour index
+void Compositor::composeSSE2(const LineLayers& layers, Palettes palettes, uint32_t* out) {
+    static_assert(LineLayers::WIDTH % 16 == 0, "whole vectors only");
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i palette1 = _mm_set1_epi8(OBJ_PALETTE1);
+    const __m128i behindBit = _mm_set1_epi8(OBJ_BEHIND_BG);
+    __m128i index[4], bgShade[4], obp0Shade[4], obp1Shade[4], color[4];
+    for (int k = 0; k < 4; ++k) {
+        index[k] = _mm_set1_epi8(k);
+        bgShade[k] = _mm_set1_epi8(shadeOf(palettes.bgp, k));
+        obp0Shade[k] = _mm_set1_epi8(shadeOf(palettes.obp0, k));
+        obp1Shade[k] = _mm_set1_epi8(shadeOf(palettes.obp1, k));
+        color[k] = _mm_set1_epi32(static_cast<int>(SHADES[k]));
+    }
+
+    for (unsigned int x = 0; x < LineLayers::WIDTH; x += 16) {
+        __m128i bg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&layers.bg[x]));
+        __m128i obj = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&layers.obj[x]));
+        __m128i attr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&layers.attr[x]));
+
+        __m128i usePalette1 = _mm_cmpeq_epi8(_mm_and_si128(attr, palette1), palette1);
+        __m128i bgShades = zero, objShades = zero;
+        for (int k = 0; k < 4; ++k) {
+            __m128i objShade = _mm_or_si128(_mm_and_si128(usePalette1, obp1Shade[k]), _mm_andnot_si128(usePalette1, obp0Shade[k]));
+            bgShades = _mm_or_si128(bgShades, _mm_and_si128(_mm_cmpeq_epi8(bg, index[k]), bgShade[k]));
+            objShades = _mm_or_si128(objShades, _mm_and_si128(_mm_cmpeq_epi8(obj, index[k]), objShade));
+        }
+
+        // BG wins where there's no sprite, or the sprite is behind a non-zero BG pixel
+        __m128i behind = _mm_andnot_si128(_mm_cmpeq_epi8(bg, zero), _mm_cmpeq_epi8(_mm_and_si128(attr, behindBit), behindBit));
+        __m128i useBg = _mm_or_si128(_mm_cmpeq_epi8(obj, zero), behind);
+        __m128i shades = _mm_or_si128(_mm_and_si128(useBg, bgShades), _mm_andnot_si128(useBg, objShades));
+
+        // Widen to a dword per pixel, 4 at a time, and pick the colour the same way
+        __m128i low = _mm_unpacklo_epi8(shades, zero), high = _mm_unpackhi_epi8(shades, zero);
+        __m128i words[4] = { _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+                             _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero) };
+        for (int q = 0; q < 4; ++q) {
+            __m128i rgba = zero;
+            for (int k = 0; k < 4; ++k) {
+                rgba = _mm_or_si128(rgba, _mm_and_si128(_mm_cmpeq_epi32(words[q], _mm_set1_epi32(k)), color[k]));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + q * 4), rgba);
+        }
+    }
+}
+#endif
+
+#ifdef GB_SIMD_AVX2
+// The three palettes go in one 16 byte table for vpshufb (BG 0-3, OBP0 4-7, OBP1 8-11)
+// and vpermd turns shades into colours 8 at a time
+__attribute__((target("avx2")))
+void Compositor::composeAVX2(const LineLayers& layers, Palettes palettes, uint32_t* out) {
+    static_assert(LineLayers::WIDTH % 32 == 0, "whole vectors only");
+    alignas(16) uint8_t table[16] = {};
+    for (int k = 0; k < 4; ++k) {
+        table[k] = shadeOf(palettes.bgp, k);
+        table[4 + k] = shadeOf(palettes.obp0, k);
+        table[8 + k] = shadeOf(palettes.obp1, k);
+    }
+    const __m256i lookup = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+    const __m256i colors = _mm256_setr_epi32(static_cast<int>(SHADES[0]), static_cast<int>(SHADES[1]),
+                                             static_cast<int>(SHADES[2]), static_cast<int>(SHADES[3]), 0, 0, 0, 0);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i palette1 = _mm256_set1_epi8(OBJ_PALETTE1);
+    const __m256i behindBit = _mm256_set1_epi8(OBJ_BEHIND_BG);
+    const __m256i four = _mm256_set1_epi8(4);
+
+    for (unsigned int x = 0; x < LineLayers::WIDTH; x += 32) {
+        __m256i bg = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&layers.bg[x]));
+        __m256i obj = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&layers.obj[x]));
+        __m256i attr = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&layers.attr[x]));
+
+        // Sprite slot is 4 + obj, plus 4 more for OBP1
+        __m256i objSlot = _mm256_add_epi8(_mm256_add_epi8(obj, four),
+                                          _mm256_slli_epi16(_mm256_and_si256(attr, palette1), 2));
+        __m256i behind = _mm256_andnot_si256(_mm256_cmpeq_epi8(bg, zero),
+                                             _mm256_cmpeq_epi8(_mm256_and_si256(attr, behindBit), behindBit));
+        __m256i useBg = _mm256_or_si256(_mm256_cmpeq_epi8(obj, zero), behind);
+        __m256i shades = _mm256_shuffle_epi8(lookup, _mm256_blendv_epi8(objSlot, bg, useBg));
+
+        alignas(32) uint8_t shade[32];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(shade), shades);
+        for (int q = 0; q < 4; ++q) {
+            __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(shade + q * 8)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x + q * 8), _mm256_permutevar8x32_epi32(colors, index));
+        }
+    }
+}
+#endif
@@ -0,0 +1,168 @@
+// Only built with -DGB_PIXEL_FIFO, the default build draws with LineRenderer alone
+#ifdef GB_PIXEL_FIFO
+
+#include "fiforenderer.h"
+#include <algorithm>
+#include "compositor.h"
+
+void FifoRenderer::beginLine(unsigned int ly) {
+    const uint8_t lcdc = _mem[0xFF40];
+    _ly = ly;
+    _dot = 0;
+    _x = 0;
+    _stall = FETCH_DOTS;
+    _discard = _mem[0xFF43] & 7;
+    _fetchX = 0;
+    _window = (lcdc & 0x21) == 0x21 && ly >= _mem[0xFF4A];
+    _inWindow = false;
+    _bgCount = 0;
+    _objColor.fill(0);
+    _objHead = 0;
+    // OAM scan happens whatever LCDC says, whether they get fetched is decided as they come up
+    _spriteCount = _sprites.line(ly, _lineSprites);
+    _nextSprite = 0;
+}
+
+bool FifoRenderer::runTo(uint64_t dots) {
+    while (_x < WIDTH && _dot < dots) {
+        _dot++;
+        if (_stall) {
+            _stall--;
+            continue;
+        }
+        if (!_bgCount) {
+            fetchBackground();
+        }
+        if (_discard) {
+            _bgHead = (_bgHead + 1) & 7;
+            _bgCount--;
+            _discard--;
+            continue;
+        }
+
+        const uint8_t lcdc = _mem[0xFF40], wx = _mem[0xFF4B];
+        if (_window && !_inWindow && (lcdc & 0x20) && _x + 7 >= wx) {
+            // Throws away what's queued and starts fetching from the window's first column
+            _inWindow = true;
+            _bgCount = 0;
+            _fetchX = 0;
+            _discard = wx < 7 ? 7 - wx : 0;
+            _stall = WINDOW_DOTS - 1;
+            continue;
+        }
+        // Sorted by X, so only the next one can be due. X < 8 ones come up at the left edge
+        if (_nextSprite < _spriteCount && _mem[0xFE01 + _lineSprites[_nextSprite] * 4] <= _x + 8) {
+            unsigned int sprite = _lineSprites[_nextSprite++];
+            if (lcdc & 0x02) {
+                fetchSprite(sprite);
+                _stall = spritePenalty(_mem[0xFE01 + sprite * 4], _mem[0xFF43]) - 1;
+                continue;
+            }
+        }
+        outputPixel();
+    }
+    return _x >= WIDTH;
+}
+
+void FifoRenderer::fetchBackground() {
+    const uint8_t lcdc = _mem[0xFF40];
+    _bgHead = 0;
+    _bgCount = 8;
+    if (!(lcdc & 0x01)) {
+        _bg.fill(0); // BG and window off on DMG, colour 0 under the sprites
+        _fetchX++;
+        return;
+    }
+    const bool signedTiles = !(lcdc & 0x10);
+    uint16_t map;
+    unsigned int y, column;
+    if (_inWindow) {
+        map = (lcdc & 0x40) ? 0x9C00 : 0x9800;
+        y = _windowLine;
+        column = _fetchX & 31;
+    } else {
+        // SCX and SCY are read again on every fetch, which is what makes mid-line scrolls work
+        map = (lcdc & 0x08) ? 0x9C00 : 0x9800;
+        y = (_ly + _mem[0xFF42]) & 0xFF;
+        column = ((_mem[0xFF43] >> 3) + _fetchX) & 31;
+    }
+    const uint8_t* row = _tiles.row(tileIndex(_mem[map + (y / 8) * 32 + column], signedTiles), y & 7);
+    std::copy(row, row + 8, _bg.begin());
+    _fetchX++;
+}
+
+void FifoRenderer::fetchSprite(unsigned int sprite) {
+    const uint8_t* entry = &_mem[0xFE00 + sprite * 4];
+    const unsigned int height = _sprites.height();
+    unsigned int row = _ly - (entry[0] - 16);
+    if (row >= height) {
+        return; // Moved off the line since the OAM scan
+    }
+    uint8_t flags = entry[3];
+    if (flags & 0x40) {
+        row = height - 1 - row;
+    }
+    uint8_t tile = height == 16 ? entry[2] & 0xFE : entry[2];
+    const uint8_t* pixels = _tiles.row(tile + row / 8, row & 7);
+    int x0 = entry[1] - 8;
+    for (unsigned int i = 0; i < 8; ++i) {
+        int x = x0 + i;
+        if (x < static_cast<int>(_x)) {
+            continue; // Off the left edge
+        }
+        // Anything already queued came from a higher priority sprite
+        unsigned int slot = (_objHead + (x - _x)) & 7;
+        uint8_t index = pixels[(flags & 0x20) ? 7 - i : i];
+        if (index && !_objColor[slot]) {
+            _objColor[slot] = index;
+            _objFlags[slot] = flags;
+        }
+    }
+}
+
+void FifoRenderer::outputPixel() {
+    uint8_t bg = _bg[_bgHead];
+    _bgHead = (_bgHead + 1) & 7;
+    _bgCount--;
+    uint8_t obj = _objColor[_objHead], flags = _objFlags[_objHead];
+    _objColor[_objHead] = 0;
+    _objHead = (_objHead + 1) & 7;
+
+    // Palettes are read as the pixel goes out
+    uint8_t palette, index;
+    if (obj && !((flags & 0x80) && bg)) {
+        palette = _mem[(flags & 0x10) ? 0xFF49 : 0xFF48];
+        index = obj;
+    } else {
+        palette = _mem[0xFF47];
+        index = bg;
+    }
+    uint32_t shade = Compositor::SHADES[(palette >> (index * 2)) & 0x03];
+    uint32_t& pixel = _framebuffer[_ly * WIDTH + _x++];
+    _changed = _changed || pixel != shade;
+    pixel = shade;
+    if (_x == WIDTH && _inWindow) {
+        _windowLine++;
+    }
+}
+
+uint64_t FifoRenderer::mode3Cycles(unsigned int ly) const {
+    const uint8_t lcdc = _mem[0xFF40], scx = _mem[0xFF43], wx = _mem[0xFF4B];
+    unsigned int dots = FETCH_DOTS + WIDTH + (scx & 7);
+    if ((lcdc & 0x21) == 0x21 && ly >= _mem[0xFF4A] && wx < WIDTH + 7) {
+        dots += WINDOW_DOTS + (wx < 7 ? 7 - wx : 0);
+    }
+    if (lcdc & 0x02) {
+        std::array<uint8_t, SpriteBuckets::LINE_LIMIT> sprites;
+        unsigned int count = _sprites.line(ly, sprites);
+        for (unsigned int i = 0; i < count; ++i) {
+            uint8_t x = _mem[0xFE01 + sprites[i] * 4];
+            if (x < WIDTH + 8) {
+                dots += spritePenalty(x, scx);
+            }
+        }
+    }
+    return (dots + 3) / 4;
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "framewriter.h"
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_image.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+// BT.601 full range ("C420jpeg") in 8.8 fixed point. Each row sums to 0 (chroma) or
+// 256 (luma), so the DMG greys come out exact with flat chroma
+uint8_t luma(unsigned int r, unsigned int g, unsigned int b) {
+    return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+uint8_t chroma(int r, int g, int b, int cr, int cg, int cb) {
+    return std::min(255, (cr * r + cg * g + cb * b + 128 * 256 + 128) >> 8);
+}
+
+}
+
+FrameWriter::FrameWriter() : _thread(&FrameWriter::run, this) {}
+
+FrameWriter::~FrameWriter() {
+    finish();
+}
+
+bool FrameWriter::openY4M(const std::string& path) {
+    if (path == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        _y4m = stdout;
+    } else {
+        _y4m = std::fopen(path.c_str(), "wb");
+        if (!_y4m) {
+            std::cerr << "Failed to open " << path << " for the video\n";
+            return false;
+        }
+    }
+    // 4194304 Hz / 70224 dots a frame, square pixels
+    std::fprintf(_y4m, "YUV4MPEG2 W%u H%u F4194304:70224 Ip A1:1 C420jpeg\n", PPU::WIDTH, PPU::HEIGHT);
+    return true;
+}
+
+void FrameWriter::savePNGs(const std::set<uint64_t>& frames, const std::string& prefix) {
+    _pngFrames = frames;
+    _pngPrefix = prefix;
+}
+
+void FrameWriter::capture(uint64_t frame, const uint32_t* framebuffer) {
+    size_t head;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_count == QUEUE_FRAMES) {
+            _stalls++;
+            _freed.wait(lock, [this] { return _count < QUEUE_FRAMES; });
+        }
+        head = (_tail + _count) % QUEUE_FRAMES;
+    }
+    // Nobody else touches a free slot
+    Slot& slot = _slots[head];
+    std::memcpy(slot.pixels.data(), framebuffer, sizeof(Frame));
+    slot.number = frame;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _count++;
+    }
+    _filled.notify_one();
+}
+
+void FrameWriter::finish() {
+    if (!_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _filled.notify_one();
+    _thread.join();
+    if (_y4m) {
+        if (_y4m == stdout) {
+            std::fflush(_y4m);
+        } else {
+            std::fclose(_y4m);
+        }
+        _y4m = nullptr;
+    }
+}
+
+void FrameWriter::run() {
+    while (true) {
+        size_t tail;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _filled.wait(lock, [this] { return _count > 0 || _stopping; });
+            if (_count == 0) {
+                return; // Stopping and drained
+            }
+            tail = _tail;
+        }
+        write(_slots[tail]);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tail = (_tail + 1) % QUEUE_FRAMES;
+            _count--;
+        }
+        _freed.notify_one();
+    }
+}
+
+void FrameWriter::write(const Slot& slot) {
+    if (_pngFrames.count(slot.number)) {
+        writePNG(slot.pixels, slot.number);
+    }
+    if (_y4m && !_y4mFailed) {
+        writeY4M(slot.pixels);
+    }
+    _written++;
+}
+
+void FrameWriter::writeY4M(const Frame& frame) {
+    const unsigned int w = PPU::WIDTH;
+    const unsigned int h = PPU::HEIGHT;
+    _yuv.resize(w * h + 2 * (w / 2) * (h / 2));
+    uint8_t* y = _yuv.data();
+    uint8_t* u = y + w * h;
+    uint8_t* v = u + (w / 2) * (h / 2);
+    for (unsigned int i = 0; i < w * h; ++i) {
+        uint32_t p = frame[i];
+        y[i] = luma(p >> 24, (p >> 16) & 0xFF, (p >> 8) & 0xFF);
+    }
+    // Chroma from the average of each 2x2 block
+    for (unsigned int row = 0; row < h / 2; ++row) {
+        for (unsigned int col = 0; col < w / 2; ++col) {
+            int r = 0, g = 0, b = 0;
+            for (unsigned int dy = 0; dy < 2; ++dy) {
+                for (unsigned int dx = 0; dx < 2; ++dx) {
+                    uint32_t p = frame[(row * 2 + dy) * w + col * 2 + dx];
+                    r += p >> 24;
+                    g += (p >> 16) & 0xFF;
+                    b += (p >> 8) & 0xFF;
+                }
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            u[row * (w / 2) + col] = chroma(r, g, b, -43, -85, 128);
+            v[row * (w / 2) + col] = chroma(r, g, b, 128, -107, -21);
+        }
+    }
+    if (std::fputs("FRAME\n", _y4m) < 0 || std::fwrite(_yuv.data(), 1, _yuv.size(), _y4m) != _yuv.size()) {
+        // Reader went away or the disk filled up, the run carries on without the video
+        std::cerr << "Video write failed, no more frames will be written\n";
+        _y4mFailed = true;
+    }
+}
+
+void FrameWriter::writePNG(const Frame& frame, uint64_t number) {
+    std::string path = _pngPrefix + std::to_string(number) + ".png";
+    // The surface only wraps the slot, RGBA8888 is the framebuffer's 0xRRGGBBAA
+    SDL_Surface* surface = SDL_CreateSurfaceFrom(PPU::WIDTH, PPU::HEIGHT, SDL_PIXELFORMAT_RGBA8888,
+                                                 const_cast<uint32_t*>(frame.data()), PPU::WIDTH * sizeof(uint32_t));
+    if (!surface || !IMG_SavePNG(surface, path.c_str())) {
+        std::cerr << "Failed to save " << path << ": " << SDL_GetError() << "\n";
+    }
+    SDL_DestroySurface(surface);
+}
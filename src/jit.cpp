@@ -0,0 +1,530 @@
+#include "jit.h"
+#include "cpu.h"
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+JitArena::JitArena() {
+#ifdef GB_JIT_AVAILABLE
+#if defined(_WIN32)
+    void* mem = VirtualAlloc(nullptr, SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    _base = static_cast<uint8_t*>(mem);
+#else
+    void* mem = mmap(nullptr, SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    _base = mem == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mem);
+#endif
+    if (!_base) {
+        std::cerr << "JIT: could not allocate executable memory\n";
+    }
+#endif
+}
+
+JitArena::~JitArena() {
+    if (!_base) {
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(_base, 0, MEM_RELEASE);
+#else
+    munmap(_base, SIZE);
+#endif
+}
+
+uint8_t* JitArena::add(const uint8_t* code, size_t size) {
+    if (!_base || _used + size > SIZE) {
+        return nullptr;
+    }
+    uint8_t* dest = _base + _used;
+    std::memcpy(dest, code, size);
+    _used += (size + 15) & ~size_t(15);
+    return dest;
+}
+
+void JitArena::reset() {
+    _used = 0;
+}
+
+#ifdef GB_JIT_AVAILABLE
+
+namespace {
+
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Just enough of an x86-64 assembler for the block translator. The CPU object
+// lives in rbx for the whole block and anything not kept in a host register is a
+// [rbx + disp32] operand. The Memory::sideEffects() snapshot from block entry sits
+// on the stack. rax, rcx, rdx and r8-r10 are scratch, nothing survives a call in them
+class X64Emitter {
+    public:
+        std::vector<uint8_t> code;
+
+        void byte(uint8_t b) { code.push_back(b); }
+        void u16(uint16_t v) { byte(v & 0xFF); byte(v >> 8); }
+        void u32(uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); }
+        void u64(uint64_t v) { u32(v & 0xFFFFFFFF); u32(v >> 32); }
+
+        // Operand size prefix and REX for reg in ModRM.reg and rm in ModRM.rm. Byte
+        // operands need a REX for spl/bpl/sil/dil, without one those encodings mean ah..bh
+        void prefix(unsigned size, unsigned reg, unsigned rm, bool byteRegs) {
+            if (size == 16) byte(0x66);
+            uint8_t rex = 0x40 | (size == 64 ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0);
+            if (rex != 0x40 || (byteRegs && ((reg >= 4 && reg < 8) || (rm >= 4 && rm < 8)))) byte(rex);
+        }
+        void modrm(unsigned mod, unsigned reg, unsigned rm) { byte((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+        // ModRM for [rbx + disp32] with the given reg field
+        void mem(unsigned reg, int32_t disp) {
+            modrm(2, reg, RBX);
+            u32(static_cast<uint32_t>(disp));
+        }
+
+        void push(Reg r) { if (r >= 8) byte(0x41); byte(0x50 | (r & 7)); }
+        void pop(Reg r) { if (r >= 8) byte(0x41); byte(0x58 | (r & 7)); }
+
+        void prologue() {
+            for (Reg r : SAVED) push(r);
+            byte(0x48); byte(0x83); byte(0xEC); byte(FRAME); // sub rsp, FRAME
+#if defined(_WIN32)
+            mov64(RBX, RCX);
+#else
+            mov64(RBX, RDI);
+#endif
+        }
+
+        // mov eax, executed; restore and return
+        void exit(uint32_t executed) {
+            movImm32(RAX, executed);
+            byte(0x48); byte(0x83); byte(0xC4); byte(FRAME); // add rsp, FRAME
+            for (size_t i = SAVED_COUNT; i-- > 0;) pop(SAVED[i]);
+            byte(0xC3);                                       // ret
+        }
+
+        // Side effect snapshot in the spill slot above the shadow space
+        void saveSideEffects(int32_t disp) {
+            load32(RAX, disp);
+            byte(0x89); modrm(1, RAX, RSP); byte(0x24); byte(FRAME - 8); // mov [rsp+FRAME-8], eax
+        }
+        void cmpSideEffects(int32_t disp) {
+            load32(RAX, disp);
+            byte(0x3B); modrm(1, RAX, RSP); byte(0x24); byte(FRAME - 8); // cmp eax, [rsp+FRAME-8]
+        }
+
+        // Register to register, 32 bit unless it says otherwise
+        void mov32(Reg dst, Reg src) { prefix(32, src, dst, false); byte(0x89); modrm(3, src, dst); }
+        void mov8(Reg dst, Reg src) { prefix(8, src, dst, true); byte(0x88); modrm(3, src, dst); }
+        void movzx8(Reg dst, Reg src) { prefix(32, dst, src, true); byte(0x0F); byte(0xB6); modrm(3, dst, src); }
+        void alu32(uint8_t opcode, Reg dst, Reg src) { prefix(32, src, dst, false); byte(opcode); modrm(3, src, dst); }
+        void shl32(Reg r, uint8_t n) { prefix(32, 0, r, false); byte(0xC1); modrm(3, 4, r); byte(n); }
+        void shr32(Reg r, uint8_t n) { prefix(32, 0, r, false); byte(0xC1); modrm(3, 5, r); byte(n); }
+        void ror16(Reg r, uint8_t n) { prefix(16, 0, r, false); byte(0xC1); modrm(3, 1, r); byte(n); }
+        void andImm32(Reg r, uint32_t v) { prefix(32, 0, r, false); byte(0x81); modrm(3, 4, r); u32(v); }
+        void orImm32(Reg r, uint32_t v) { prefix(32, 0, r, false); byte(0x81); modrm(3, 1, r); u32(v); }
+        void movImm32(Reg r, uint32_t v) { prefix(32, 0, r, false); byte(0xB8 | (r & 7)); u32(v); }
+        void movImm64(Reg r, uint64_t v) { prefix(64, 0, r, false); byte(0xB8 | (r & 7)); u64(v); }
+        void inc32(Reg r) { prefix(32, 0, r, false); byte(0xFF); modrm(3, 0, r); }
+        void dec32(Reg r) { prefix(32, 0, r, false); byte(0xFF); modrm(3, 1, r); }
+        void inc16(Reg r) { prefix(16, 0, r, false); byte(0xFF); modrm(3, 0, r); }
+        void dec16(Reg r) { prefix(16, 0, r, false); byte(0xFF); modrm(3, 1, r); }
+        void setz(Reg r) { prefix(8, 0, r, true); byte(0x0F); byte(0x94); modrm(3, 0, r); }
+
+        // movzx dst, byte [base + index], base can't be rbp or r13
+        void loadIndexed8(Reg dst, Reg base, Reg index) {
+            uint8_t rex = 0x40 | (dst >= 8 ? 0x04 : 0) | (index >= 8 ? 0x02 : 0) | (base >= 8 ? 0x01 : 0);
+            if (rex != 0x40) byte(rex);
+            byte(0x0F); byte(0xB6); modrm(0, dst, RSP);
+            byte(((index & 7) << 3) | (base & 7)); // SIB, scale 1
+        }
+
+        // Against [rbx + disp]
+        void load8(Reg dst, int32_t disp) { prefix(32, dst, RBX, false); byte(0x0F); byte(0xB6); mem(dst, disp); } // movzx
+        void load16(Reg dst, int32_t disp) { prefix(32, dst, RBX, false); byte(0x0F); byte(0xB7); mem(dst, disp); } // movzx
+        void load32(Reg dst, int32_t disp) { prefix(32, dst, RBX, false); byte(0x8B); mem(dst, disp); }
+        void store8(int32_t disp, Reg src) { prefix(8, src, RBX, true); byte(0x88); mem(src, disp); }
+        void store16(int32_t disp, Reg src) { prefix(16, src, RBX, false); byte(0x89); mem(src, disp); }
+        void cmpByteZero(int32_t disp) { byte(0x80); mem(7, disp); byte(0x00); }                      // cmp byte [rbx+disp], 0
+        void storeImm8(int32_t disp, uint8_t v) { byte(0xC6); mem(0, disp); byte(v); }                // mov byte [rbx+disp], imm8
+        void storeImm16(int32_t disp, uint16_t v) { byte(0x66); byte(0xC7); mem(0, disp); u16(v); }   // mov word [rbx+disp], imm16
+        void storeImm32(int32_t disp, uint32_t v) { byte(0xC7); mem(0, disp); u32(v); }               // mov dword [rbx+disp], imm32
+        void addImm16(int32_t disp, uint16_t v) { byte(0x66); byte(0x81); mem(0, disp); u16(v); }     // add word [rbx+disp], imm16
+        void addQword(int32_t disp, uint32_t v) { byte(0x48); byte(0x81); mem(0, disp); u32(v); }     // add qword [rbx+disp], imm32
+
+        void call(const void* target) {
+#if defined(_WIN32)
+            mov64(RCX, RBX);
+#else
+            mov64(RDI, RBX);
+#endif
+            movImm64(RAX, reinterpret_cast<uint64_t>(target));
+            byte(0xFF); byte(0xD0); // call rax
+        }
+
+        // Short conditional jump with the target patched in later
+        size_t jcc(uint8_t opcode) {
+            byte(opcode);
+            byte(0x00);
+            return code.size();
+        }
+        void patch(size_t from) {
+            code[from - 1] = static_cast<uint8_t>(code.size() - from);
+        }
+
+        static const uint8_t JNE = 0x75;
+        static const uint8_t JE = 0x74;
+
+        // Second byte of the register forms of these
+        static const uint8_t ADD = 0x01;
+        static const uint8_t OR = 0x09;
+        static const uint8_t AND = 0x21;
+        static const uint8_t SUB = 0x29;
+        static const uint8_t XOR = 0x31;
+
+    private:
+        // Callee saved ones the block uses, rbx for the CPU and the rest for guest registers
+        static const size_t SAVED_COUNT = 6;
+        static constexpr Reg SAVED[SAVED_COUNT] = { RBX, RBP, R12, R13, R14, R15 };
+        // Six pushes leave rsp 8 off 16 byte alignment, this fixes that for calls and
+        // holds the side effect snapshot (plus the shadow space on Windows)
+#if defined(_WIN32)
+        static const uint8_t FRAME = 40;
+#else
+        static const uint8_t FRAME = 8;
+#endif
+
+        void mov64(Reg dst, Reg src) { prefix(64, src, dst, false); byte(0x89); modrm(3, src, dst); }
+};
+
+// Conservative: anything that can touch memory, HALT/STOP or the IME
+bool mayHaveSideEffects(uint8_t opcode, uint8_t operand) {
+    uint8_t x = opcode >> 6, y = (opcode >> 3) & 7, z = opcode & 7;
+    switch (x) {
+        case 0: return z == 2 || (y == 6 && z >= 4 && z <= 6) || opcode == 0x08 || opcode == 0x10;
+        case 1: return y == 6 || z == 6;
+        case 2: return z == 6;
+        default:
+            if (opcode == 0xCB) return (operand & 7) == 6;
+            return z != 6;
+    }
+}
+
+}
+
+bool CPU::compileNative(Block& block) {
+    auto offset = [this](const void* field) {
+        return static_cast<int32_t>(static_cast<const uint8_t*>(field) - reinterpret_cast<const uint8_t*>(this));
+    };
+    const int32_t pcOffset = offset(&_PC);
+    const int32_t sideEffectsOffset = offset(_mem.sideEffectsCounter());
+    const int32_t cyclesOffset = offset(&_cycles);
+
+    // Inline code works on the guest registers in callee saved host registers, a pair
+    // to each with the high byte in bits 8-15. A goes with F the other way round (F above A)
+    // so the ALU gets A as a plain byte register. Indexed like the opcode's register
+    // field, 6 is (HL) and 8 is F
+    struct Home {
+        Reg host;
+        uint8_t shift;
+    };
+    static const Home homes[9] = { { R13, 8 }, { R13, 0 }, { R14, 8 }, { R14, 0 }, { R15, 8 }, { R15, 0 },
+                                   { RAX, 0 }, { R12, 0 }, { R12, 8 } };
+    const unsigned int F = 8;
+    // What goes back into the CPU object: low byte, high byte, host register
+    struct Unit {
+        uint8_t* low;
+        uint8_t* high;
+        Reg host;
+    };
+    const Unit units[4] = { { &_A, &_F, R12 }, { &_C, &_B, R13 }, { &_E, &_D, R14 }, { &_L, &_H, R15 } };
+    // Unit 4 is SP, in rbp
+    auto unitOf = [](unsigned int r) { return r == 7 || r == F ? 0u : r / 2 + 1; };
+
+    X64Emitter e;
+    // A unit is read into its host register the first time inline code wants it and
+    // stays there until the next handler call. Only the ones inline code changed get
+    // written back, and since handlers can change any of them they all count as not
+    // loaded after a call. Runs of handlers don't move anything around that way
+    unsigned int loaded = 0;
+    unsigned int dirty = 0;
+    auto spill = [&]() {
+        for (unsigned int u = 0; u < 4; ++u) {
+            if (dirty & (1 << u)) {
+                e.store8(offset(units[u].low), units[u].host);
+                e.mov32(RAX, units[u].host);
+                e.shr32(RAX, 8);
+                e.store8(offset(units[u].high), RAX);
+            }
+        }
+        if (dirty & (1 << 4)) {
+            e.store16(offset(&_SP), RBP);
+        }
+        dirty = 0;
+    };
+    auto fill = [&](unsigned int u) {
+        if (loaded & (1 << u)) {
+            return;
+        }
+        loaded |= 1 << u;
+        if (u == 4) {
+            e.load16(RBP, offset(&_SP));
+            return;
+        }
+        e.load8(units[u].host, offset(units[u].high));
+        e.shl32(units[u].host, 8);
+        e.load8(RAX, offset(units[u].low));
+        e.alu32(X64Emitter::OR, units[u].host, RAX);
+    };
+    // Scratch register from/to a guest one, the upper bits of dst are zeroed
+    auto load = [&](Reg dst, unsigned int r) {
+        fill(unitOf(r));
+        if (homes[r].shift) {
+            e.mov32(dst, homes[r].host);
+            e.shr32(dst, 8);
+        } else {
+            e.movzx8(dst, homes[r].host);
+        }
+    };
+    auto store = [&](unsigned int r, Reg src) {
+        fill(unitOf(r));
+        if (homes[r].shift) {
+            e.ror16(homes[r].host, 8);
+            e.mov8(homes[r].host, src);
+            e.ror16(homes[r].host, 8);
+        } else {
+            e.mov8(homes[r].host, src);
+        }
+        dirty |= 1 << unitOf(r);
+    };
+
+    // A op= ecx for ADD ADC SUB SBC AND XOR OR CP, y being the opcode's operation field
+    auto alu = [&](unsigned int y) {
+        fill(0);
+        e.movzx8(RAX, R12);
+        if (y >= 4 && y <= 6) {
+            static const uint8_t logic[3] = { X64Emitter::AND, X64Emitter::XOR, X64Emitter::OR };
+            uint32_t h = y == 4 ? 0x20 : 0; // H always 1 for AND
+#ifdef GB_LAZY_FLAGS
+            e.alu32(logic[y - 4], RAX, RCX);
+            e.storeImm8(offset(&_flagOp), static_cast<uint8_t>(FlagOp::Fixed));
+            e.store16(offset(&_flagResult), RAX);
+            e.movImm32(RDX, h << 8);
+#else
+            e.alu32(X64Emitter::XOR, RDX, RDX);
+            e.alu32(logic[y - 4], RAX, RCX);
+            e.setz(RDX);
+            e.shl32(RDX, 15); // Z into bit 7 of F
+            if (h) e.orImm32(RDX, h << 8);
+#endif
+            e.alu32(X64Emitter::OR, RDX, RAX);
+            e.mov32(R12, RDX);
+            dirty |= 1;
+            return;
+        }
+
+        bool subtract = y >= 2;
+        // Carry in for ADC/SBC
+        if (y == 1 || y == 3) {
+#ifdef GB_LAZY_FLAGS
+            e.load16(RDX, offset(&_flagResult));
+            e.shr32(RDX, 8);
+#else
+            e.mov32(RDX, R12);
+            e.shr32(RDX, 12);
+#endif
+            e.andImm32(RDX, 1);
+        } else {
+            e.alu32(X64Emitter::XOR, RDX, RDX);
+        }
+        uint8_t op = subtract ? X64Emitter::SUB : X64Emitter::ADD;
+        e.mov32(R8, RAX);
+        e.alu32(op, R8, RCX);
+        e.alu32(op, R8, RDX);
+#ifdef GB_LAZY_FLAGS
+        e.storeImm8(offset(&_flagOp), static_cast<uint8_t>(subtract ? FlagOp::Sub : FlagOp::Add));
+        e.store8(offset(&_flagA), RAX);
+        e.store8(offset(&_flagB), RCX);
+        if (subtract) e.andImm32(R8, 0x1FF); // Wraps, so bit 8 is the borrow
+        e.store16(offset(&_flagResult), R8);
+        if (y != 7) {
+            e.mov8(R12, R8);
+        }
+#else
+        // F = ADD/SUB[carry << 16 | a << 8 | b]
+        e.shl32(RDX, 16);
+        e.mov32(R9, RAX);
+        e.shl32(R9, 8);
+        e.alu32(X64Emitter::OR, RDX, R9);
+        e.alu32(X64Emitter::OR, RDX, RCX);
+        e.movImm64(R10, reinterpret_cast<uint64_t>(subtract ? AluTables::SUB.data() : AluTables::ADD.data()));
+        e.loadIndexed8(RDX, R10, RDX);
+        e.shl32(RDX, 8);
+        if (y == 7) { // CP keeps A
+            e.alu32(X64Emitter::OR, RDX, RAX);
+        } else {
+            e.movzx8(R8, R8);
+            e.alu32(X64Emitter::OR, RDX, R8);
+        }
+        e.mov32(R12, RDX);
+#endif
+        dirty |= 1;
+    };
+
+    // INC r / DEC r, which keep C
+    auto incDec = [&](unsigned int r, bool dec) {
+        load(RCX, r);
+#ifdef GB_LAZY_FLAGS
+        e.storeImm8(offset(&_flagOp), static_cast<uint8_t>(dec ? FlagOp::Sub : FlagOp::Add));
+        e.store8(offset(&_flagA), RCX);
+        e.storeImm8(offset(&_flagB), 1);
+        if (dec) e.dec32(RCX);
+        else e.inc32(RCX);
+        e.load16(RDX, offset(&_flagResult));
+        e.andImm32(RDX, 0x100);
+        e.movzx8(RAX, RCX);
+        e.alu32(X64Emitter::OR, RDX, RAX);
+        e.store16(offset(&_flagResult), RDX);
+#else
+        fill(0);
+        e.movImm64(RAX, reinterpret_cast<uint64_t>(dec ? AluTables::DEC.data() : AluTables::INC.data()));
+        e.loadIndexed8(RDX, RAX, RCX);
+        e.shl32(RDX, 8);
+        e.andImm32(R12, 0x10FF); // Keep C flag only
+        e.alu32(X64Emitter::OR, R12, RDX);
+        dirty |= 1;
+        if (dec) e.dec32(RCX);
+        else e.inc32(RCX);
+#endif
+        store(r, RCX);
+    };
+
+    e.prologue();
+    e.saveSideEffects(sideEffectsOffset);
+
+    // PC and the cycle counter only have to be right when something can observe them,
+    // so inline ops just add to the pending deltas. Handlers count their own cycles
+    uint16_t pc = block.start;
+    uint16_t pcDelta = 0;
+    uint32_t cycleDelta = 0;
+    uint32_t instructions = 0;
+    for (size_t i = 0; i < block.ops.size(); ++i) {
+        const DecodedOp& op = block.ops[i];
+        uint8_t x = op.opcode >> 6, y = (op.opcode >> 3) & 7, z = op.opcode & 7, p = y >> 1, q = y & 1;
+        pc += op.length;
+        pcDelta += op.length;
+        instructions += op.count;
+
+        // --- Translated inline, fused ops always go through their handler ---
+        if (op.count == 1) {
+            cycleDelta += _opCycles[op.opcode];
+            if (op.opcode == 0x00) { // NOP
+                continue;
+            }
+            if (x == 1 && y != 6 && z != 6) { // LD r, r
+                if (y != z) {
+                    load(RCX, z);
+                    store(y, RCX);
+                }
+                continue;
+            }
+            if (x == 0 && z == 6 && y != 6) { // LD r, d8
+                e.movImm32(RCX, op.operand & 0xFF);
+                store(y, RCX);
+                continue;
+            }
+            if (x == 0 && z == 1 && q == 0) { // LD rr, d16
+                unsigned int u = p == 3 ? 4 : p + 1;
+                e.movImm32(p == 3 ? RBP : units[u].host, op.operand & 0xFFFF);
+                loaded |= 1 << u;
+                dirty |= 1 << u;
+                continue;
+            }
+            if (x == 0 && z == 3) { // INC rr / DEC rr
+                unsigned int u = p == 3 ? 4 : p + 1;
+                Reg host = p == 3 ? RBP : units[u].host;
+                fill(u);
+                if (q == 0) e.inc16(host);
+                else e.dec16(host);
+                dirty |= 1 << u;
+                continue;
+            }
+            if (x == 0 && (z == 4 || z == 5) && y != 6) { // INC r / DEC r
+                incDec(y, z == 5);
+                continue;
+            }
+            if (x == 2 && z != 6) { // ALU A, r
+                load(RCX, z);
+                alu(y);
+                continue;
+            }
+            if (x == 3 && z == 6) { // ALU A, d8
+                e.movImm32(RCX, op.operand & 0xFF);
+                alu(y);
+                continue;
+            }
+            if (op.opcode == 0xC3) { // JP a16, always the last op
+                e.storeImm16(pcOffset, op.operand);
+                pcDelta = 0;
+                continue;
+            }
+            if (op.opcode == 0x18) { // JR r8, target is known now
+                e.storeImm16(pcOffset, pc + static_cast<int8_t>(op.operand & 0xFF));
+                pcDelta = 0;
+                continue;
+            }
+            cycleDelta -= _opCycles[op.opcode];
+        }
+
+        // --- Everything else calls the interpreter's handler ---
+        spill();
+        if (pcDelta) {
+            e.addImm16(pcOffset, pcDelta);
+            pcDelta = 0;
+        }
+        if (cycleDelta) {
+            e.addQword(cyclesOffset, cycleDelta);
+            cycleDelta = 0;
+        }
+        e.storeImm32(offset(&_operand), op.operand);
+        e.call(reinterpret_cast<const void*>(op.handler));
+        loaded = 0;
+
+        // Leave the block the same way the interpreter loop would. Nothing is dirty
+        // straight after a call so there is nothing to write back first
+        if (i + 1 < block.ops.size() && (op.count > 1 || mayHaveSideEffects(op.opcode, op.operand & 0xFF))) {
+            e.cmpByteZero(offset(&_mem.stop));
+            size_t stopped = e.jcc(X64Emitter::JNE);
+            e.cmpByteZero(offset(&_halted));
+            size_t halted = e.jcc(X64Emitter::JNE);
+            e.cmpSideEffects(sideEffectsOffset);
+            size_t unchanged = e.jcc(X64Emitter::JE);
+            e.patch(stopped);
+            e.patch(halted);
+            e.exit(instructions);
+            e.patch(unchanged);
+        }
+    }
+    spill();
+    if (pcDelta) {
+        e.addImm16(pcOffset, pcDelta);
+    }
+    if (cycleDelta) {
+        e.addQword(cyclesOffset, cycleDelta);
+    }
+    e.exit(instructions);
+
+    uint8_t* code = _jit.add(e.code.data(), e.code.size());
+    if (!code) {
+        return false;
+    }
+    block.native = reinterpret_cast<NativeBlock>(code);
+    return true;
+}
+
+#else
+
+bool CPU::compileNative(Block&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "linerenderer.h"
+#include <algorithm>
+#include <cstring>
+#include "compositor.h"
+#include "utils.h"
+
+LineRenderer::LineRenderer(const uint8_t* mem) : _mem(mem), _tiles(mem + 0x8000), _sprites(mem + 0xFE00) {
+    clear();
+}
+
+void LineRenderer::clear() {
+    _changed = _changed || std::any_of(_framebuffer.begin(), _framebuffer.end(),
+                                       [](uint32_t pixel) { return pixel != Compositor::SHADES[0]; });
+    _framebuffer.fill(Compositor::SHADES[0]);
+}
+
+void LineRenderer::resync(const LineRenderer& from) {
+    _framebuffer = from._framebuffer;
+    _windowLine = from._windowLine;
+    _changed = true;
+    _tiles.invalidateAll();
+    // The buckets remember which Y each sprite is filed under, so moving them to what
+    // OAM holds now works however stale they are
+    for (unsigned int sprite = 0; sprite < SpriteBuckets::SPRITE_COUNT; ++sprite) {
+        _sprites.oamWritten(0xFE00 + sprite * 4);
+    }
+    lcdcWritten(_mem[0xFF40]);
+}
+
+uint64_t LineRenderer::hash() const {
+    // R, G and B, alpha is always 0xFF
+    uint64_t hash = FNV_OFFSET;
+    for (uint32_t pixel : _framebuffer) {
+        hash = fnv1a(hash, pixel >> 8, 3);
+    }
+    return hash;
+}
+
+void LineRenderer::renderLine(unsigned int ly) {
+    const uint8_t lcdc = _mem[0xFF40];
+    const uint8_t scy = _mem[0xFF42], scx = _mem[0xFF43];
+    const uint8_t wy = _mem[0xFF4A], wx = _mem[0xFF4B];
+    const bool signedTiles = !(lcdc & 0x10);
+
+    // Colour indices per layer, the compositor does priority and palettes
+    LineLayers layers;
+    std::array<uint8_t, WIDTH>& bg = layers.bg;
+    bg.fill(0);
+    layers.obj.fill(0);
+    layers.attr.fill(0);
+    if (lcdc & 0x01) {
+        uint16_t map = (lcdc & 0x08) ? 0x9C00 : 0x9800;
+        uint8_t y = ly + scy;
+        // A cached row per tile, the first one can start part way in with SCX
+        for (unsigned int x = 0; x < WIDTH;) {
+            uint8_t px = x + scx;
+            const uint8_t* row = _tiles.row(tileIndex(_mem[map + (y / 8) * 32 + px / 8], signedTiles), y & 7);
+            for (unsigned int column = px & 7; column < 8 && x < WIDTH; ++column) {
+                bg[x++] = row[column];
+            }
+        }
+
+        // Window, only on lines it actually covers, which is what moves its own line counter
+        if ((lcdc & 0x20) && ly >= wy && wx < WIDTH + 7) {
+            uint16_t windowMap = (lcdc & 0x40) ? 0x9C00 : 0x9800;
+            unsigned int y = _windowLine;
+            for (unsigned int x = std::max(0, wx - 7); x < WIDTH;) {
+                unsigned int wxPos = x + 7 - wx;
+                const uint8_t* row = _tiles.row(tileIndex(_mem[windowMap + (y / 8) * 32 + wxPos / 8], signedTiles), y & 7);
+                for (unsigned int column = wxPos & 7; column < 8 && x < WIDTH; ++column) {
+                    bg[x++] = row[column];
+                }
+            }
+            _windowLine++;
+        }
+    }
+
+    const Compositor::Palettes palettes = { _mem[0xFF47], _mem[0xFF48], _mem[0xFF49] };
+    std::array<uint32_t, WIDTH> line;
+    if (!(lcdc & 0x02)) {
+        Compositor::compose(layers, palettes, line.data());
+        storeLine(ly, line);
+        return;
+    }
+
+    const unsigned int height = _sprites.height();
+    std::array<uint8_t, SpriteBuckets::LINE_LIMIT> sprites;
+    unsigned int count = _sprites.line(ly, sprites);
+
+    // Only the highest priority opaque pixel is kept, whether it shows over the BG is up to the compositor
+    for (unsigned int s = 0; s < count; ++s) {
+        const uint8_t* entry = &_mem[0xFE00 + sprites[s] * 4];
+        int x0 = entry[1] - 8;
+        uint8_t tile = height == 16 ? entry[2] & 0xFE : entry[2];
+        uint8_t flags = entry[3];
+        unsigned int row = ly - (entry[0] - 16);
+        if (flags & 0x40) {
+            row = height - 1 - row;
+        }
+        uint8_t attr = ((flags & 0x10) ? Compositor::OBJ_PALETTE1 : 0) | ((flags & 0x80) ? Compositor::OBJ_BEHIND_BG : 0);
+        const uint8_t* pixels = _tiles.row(tile + row / 8, row & 7);
+        for (unsigned int i = 0; i < 8; ++i) {
+            int x = x0 + i;
+            if (x < 0 || x >= static_cast<int>(WIDTH) || layers.obj[x]) {
+                continue;
+            }
+            uint8_t index = pixels[(flags & 0x20) ? 7 - i : i];
+            if (index == 0) {
+                continue; // Transparent, a lower priority sprite can still show here
+            }
+            layers.obj[x] = index;
+            layers.attr[x] = attr;
+        }
+    }
+    Compositor::compose(layers, palettes, line.data());
+    storeLine(ly, line);
+}
+
+void LineRenderer::storeLine(unsigned int ly, const std::array<uint32_t, WIDTH>& line) {
+    // Once something in the frame has changed there's no need to compare
+    uint32_t* out = &_framebuffer[ly * WIDTH];
+    if (_changed || std::memcmp(out, line.data(), sizeof(line)) != 0) {
+        std::memcpy(out, line.data(), sizeof(line));
+        _changed = true;
+    }
+}
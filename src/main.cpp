@@ -1,9 +1,16 @@
 #include <SDL3/SDL.h>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <set>
+#include <thread>
 #include "cpu.h"
 #include "memory.h"
+#include "bench.h"
+#include "presenter.h"
+#include "framewriter.h"
 
 std::vector<uint8_t> readROM(const std::string& path) {
     std::ifstream file(path, std::ios::binary);
@@ -49,33 +56,175 @@ void printMessageFrom(uint16_t startAddr, CPU& cpu) {
     std::cout << "\n";
 }
 
-int main(int argc, char* argv[]) {
-    
-    CPU cpu;
-    std::vector<uint8_t> rom = readROM("ROMS/01-special.gb");
-    std::vector<uint8_t> rom2 = readROM("ROMS/cpu_instrs.gb");
-    
-    trimTrailingZeros(rom2);
-    dumpROM(rom2);
-
-    cpu.loadROM(rom);
-
-    for (int i = 0; i < 2215000; ++i) {
-        if (cpu.stop()) {
-            std::cout << "lajskhdahs" << std::endl;
-            std::cerr << "\n[DEBUG] Serial output started with 'f' — test failed\n";
+// Emulation thread for the window: runs in real time a frame at a time and hands
+// each one to the presenter, which shows them on the main thread
+void emulate(CPU& cpu, Presenter& presenter, uint64_t maxFrames) {
+    cpu.setRealtime(true);
+    uint64_t frames = 0;
+    while (presenter.running() && (maxFrames == 0 || frames < maxFrames)) {
+        // Two frames of budget so an LCD that's switched off still gets the stop checks
+        CPU::RunResult result = cpu.runUntil(Memory::EVENT_VBLANK, PPU::FRAME_CYCLES * 2);
+        if (result == CPU::RunResult::VBlank) {
+            bool changed = cpu.ppu().framebufferChanged();
+            presenter.submit(cpu.ppu().framebuffer(), changed);
+            frames++;
+        } else if (result == CPU::RunResult::Halted) {
+            std::cout << "CPU halted cleanly with no interrupts.\n";
+            break;
+        } else if (result == CPU::RunResult::Unhandled) {
+            std::cerr << "Stopped on an unhandled opcode at PC: 0x" << std::hex << cpu.getPC() << std::dec << "\n";
             break;
         }
-        cpu.step();
+    }
+    // A frame limit is for unattended runs, otherwise leave the last picture up
+    if (maxFrames) {
+        presenter.stop();
+    }
+}
+
+// Runs as fast as it goes with no SDL video, until the blargg verdict comes over
+// serial, maxFrames (if set) or two emulated minutes. Frames the writer wants get
+// copied out at vblank, everything else about them happens on its thread
+void runHeadless(CPU& cpu, FrameWriter& writer, uint64_t maxFrames) {
+    const uint64_t MAX_CYCLES = PPU::FRAME_CYCLES * 60 * 120;
+    while (cpu.cycles() < MAX_CYCLES && (maxFrames == 0 || cpu.ppu().frames() < maxFrames)) {
+        uint64_t budget = std::min<uint64_t>(PPU::FRAME_CYCLES, MAX_CYCLES - cpu.cycles());
+        CPU::RunResult result = cpu.runUntil(Memory::EVENT_VBLANK | Memory::EVENT_SERIAL, budget);
 
-        if (cpu.isHalted() && !cpu.interruptPending()) {
+        if (result == CPU::RunResult::VBlank) {
+            uint64_t frame = cpu.ppu().frames();
+            if (writer.wants(frame)) {
+                writer.capture(frame, cpu.ppu().framebuffer());
+            }
+        }
+        // A serial byte can come in the same instruction as vblank, so look either way
+        if (result == CPU::RunResult::SerialByte || result == CPU::RunResult::VBlank) {
+            std::string log = cpu.getLog();
+            if (log.find("Passed") != std::string::npos || log.find("Failed") != std::string::npos) {
+                break;
+            }
+        } else if (result == CPU::RunResult::Halted) {
             std::cout << "CPU halted cleanly with no interrupts.\n";
             break;
+        } else if (result == CPU::RunResult::Unhandled) {
+            std::cerr << "Stopped on an unhandled opcode at PC: 0x" << std::hex << cpu.getPC() << std::dec << "\n";
+            break;
         }
     }
-    
+    std::cout << "\n";
+}
 
+// "60,120,300" into a set of frame numbers
+std::set<uint64_t> parseFrameList(const std::string& list) {
+    std::set<uint64_t> frames;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        frames.insert(std::strtoull(list.substr(start, comma - start).c_str(), nullptr, 10));
+        start = comma + 1;
+    }
+    return frames;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmark(argc > 2 ? argv[2] : "cpu");
+    }
 
+    std::string path = "ROMS/01-special.gb";
+    bool idleSkipping = true;
+    CPU::ExecMode execMode = CPU::ExecMode::Cached;
+    bool renderThread = false;
+    PPU::DrawPolicy drawPolicy = PPU::DrawPolicy::EveryFrame;
+    unsigned int drawEvery = 1;
+    int scale = 4;
+    uint64_t maxFrames = 0;
+    bool headless = false;
+    std::set<uint64_t> pngFrames;
+    std::string pngPrefix = "frame_";
+    std::string y4mPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-idle-skip") {
+            idleSkipping = false; // For checking the skip doesn't change results
+        } else if (arg == "--exec" && i + 1 < argc) {
+            // Same results either way, for comparing the backends on any ROM
+            std::string value = argv[++i];
+            if (value == "interp") {
+                execMode = CPU::ExecMode::Interpreter;
+            } else if (value == "cached") {
+                execMode = CPU::ExecMode::Cached;
+            } else if (value == "jit") {
+                execMode = CPU::ExecMode::JIT;
+            } else {
+                std::cerr << "Unknown --exec mode " << value << ", expected interp, cached or jit\n";
+                return 1;
+            }
+        } else if (arg == "--render-thread") {
+            renderThread = true;
+        } else if (arg == "--draw" && i + 1 < argc) {
+            // "never", or draw every nth frame. The ROM runs the same either way
+            std::string value = argv[++i];
+            if (value == "never") {
+                drawPolicy = PPU::DrawPolicy::Never;
+            } else {
+                drawPolicy = PPU::DrawPolicy::EveryNth;
+                drawEvery = std::max(1, std::atoi(value.c_str()));
+            }
+        } else if (arg == "--scale" && i + 1 < argc) {
+            scale = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--frames" && i + 1 < argc) {
+            maxFrames = std::strtoull(argv[++i], nullptr, 10); // Quit after this many, 0 runs until closed
+        } else if (arg == "--headless") {
+            headless = true; // No window, for CI. The rest of these only apply here
+        } else if (arg == "--png" && i + 1 < argc) {
+            pngFrames = parseFrameList(argv[++i]);
+        } else if (arg == "--png-prefix" && i + 1 < argc) {
+            pngPrefix = argv[++i];
+        } else if (arg == "--y4m" && i + 1 < argc) {
+            y4mPath = argv[++i]; // A file, a named pipe or "-" for stdout
+        } else {
+            path = arg;
+        }
+    }
+    if (y4mPath == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf()); // Keep the serial output and such out of the video
+    }
+    CPU cpu;
+    cpu.setExecMode(execMode);
+    cpu.setIdleSkipping(idleSkipping);
+    cpu.ppu().setRenderThread(renderThread);
+    cpu.ppu().setDrawPolicy(drawPolicy, drawEvery);
+    cpu.loadROM(readROM(path));
 
+    if (headless) {
+        FrameWriter writer;
+        if (!y4mPath.empty() && !writer.openY4M(y4mPath)) {
+            return 1;
+        }
+        writer.savePNGs(pngFrames, pngPrefix);
+        runHeadless(cpu, writer, maxFrames);
+        writer.finish();
+        if (!y4mPath.empty() || !pngFrames.empty()) {
+            std::cerr << writer.framesWritten() << " frames written, capture waited on the writer "
+                      << writer.stalls() << " times\n";
+        }
+        return 0;
+    }
+
+    Presenter presenter;
+    if (!presenter.open("GB", scale)) {
+        return 1;
+    }
+    std::thread emulation(emulate, std::ref(cpu), std::ref(presenter), maxFrames);
+    presenter.run();
+    emulation.join();
+
+    Presenter::Stats stats = presenter.stats();
+    std::cout << "\n" << stats.submitted << " frames, " << stats.unchanged << " unchanged, "
+              << stats.presented << " presented\n";
     return 0;
-}
\ No newline at end of file
+}
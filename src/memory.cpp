@@ -1,55 +1,291 @@
 #include "memory.h"
+#include <algorithm>
 
-Memory::Memory() {
-    _mem.fill(0);
+Memory::Memory() : _ppu(_mem.data()) {
+    // Start with everything on the slow path, then open up the plain RAM regions
+    _readPages.fill(nullptr);
+    _writePages.fill(nullptr);
+    _writeTargets.fill(nullptr);
+    _codePages.fill(false);
+    _codeBytes.fill(std::bitset<PAGE_SIZE>());
+    _pageGeneration.fill(0);
+
+    mapCartridge();                                           // ROM banks and cartridge RAM
+    mapPages(0x8000, 0x9FFF, &_mem[0x8000], nullptr);        // VRAM, writes let the PPU catch up first
+    mapPages(0xC000, 0xDFFF, &_mem[0xC000], &_mem[0xC000]);  // WRAM
+    mapPages(0xE000, 0xFDFF, &_mem[0xC000], &_mem[0xC000]);  // Echo, the same bytes again
+    mapPages(0xFE00, 0xFEFF, &_mem[0xFE00], nullptr);        // OAM, same as VRAM
+    // IO and HRAM. Reads go the slow way too, some registers are worked out from the clock
+    mapPages(0xFF00, 0xFFFF, nullptr, nullptr);
+
+    _scheduler.setHandler(Scheduler::Event::Serial, serialDone, this);
+    _scheduler.setHandler(Scheduler::Event::Timer, timerOverflow, this);
+    _scheduler.setHandler(Scheduler::Event::PPU, ppuEvent, this);
+
+    // The LCD is on with the usual palette by the time the boot ROM hands over
+    _mem[0xFF40] = 0x91;
+    _mem[0xFF47] = 0xFC;
+    _ppu.lcdWritten(0xFF40);
+    _ppu.lcdWritten(0xFF47);
+    _ppu.registerWritten(0xFF40, 0x91, 0);
+    schedulePPU();
+}
+
+void Memory::mapPages(uint16_t start, uint16_t end, const uint8_t* read, uint8_t* write) {
+    // read/write point at the byte backing `start`, nullptr leaves the page on the slow path
+    for (unsigned int page = start >> PAGE_SHIFT; page <= (end >> PAGE_SHIFT); ++page) {
+        unsigned int offset = (page << PAGE_SHIFT) - start;
+        _readPages[page] = read ? read + offset : nullptr;
+        _writeTargets[page] = write ? write + offset : nullptr;
+        _writePages[page] = _codePages[page] ? nullptr : _writeTargets[page];
+    }
+}
+
+void Memory::mapCartridge() {
+    // ROM writes always go to the MBC, so only the read side is mapped
+    mapPages(0x0000, 0x3FFF, _cart.romBank0(), nullptr);
+    mapPages(0x4000, 0x7FFF, _cart.romBankN(), nullptr);
+    mapPages(0xA000, 0xBFFF, _cart.ramBank(), _cart.ramBank());
+
+    // Cached code in cartridge RAM can't be tracked across banks, so drop it on any switch.
+    // ROM needs nothing, codeKey already tells the banks apart
+    for (unsigned int page = 0xA000 >> PAGE_SHIFT; page <= (0xBFFF >> PAGE_SHIFT); ++page) {
+        _pageGeneration[page]++;
+    }
 }
 
-uint8_t Memory::read(uint16_t address) const {
+uint32_t Memory::codeKey(uint16_t address) const {
+    // ROM gets its offset in the image, everything else sits above the largest ROM
+    const uint32_t ramBase = Cartridge::MAX_ROM_SIZE;
+    if (address < 0x4000) {
+        return _cart.currentROMBank0() * Cartridge::ROM_BANK_SIZE + address;
+    }
+    if (address < 0x8000) {
+        return _cart.currentROMBank() * Cartridge::ROM_BANK_SIZE + (address - 0x4000);
+    }
     if (address >= 0xA000 && address <= 0xBFFF) {
-        if (ram_enabled) {
-            return ext_ram[address - 0xA000];
-        } else {
-            return 0xFF; // Open bus behavior
-        }
+        return ramBase + SIZE + _cart.currentRAMBank() * Cartridge::RAM_BANK_SIZE + (address - 0xA000);
     }
-    return _mem[address];
+    return ramBase + (homePage(address) << PAGE_SHIFT) + (address & (PAGE_SIZE - 1));
 }
 
-void Memory::write(uint16_t address, uint8_t value) {
-    // --- RAM enable (for MBC1/MBC3 test ROMs) ---
-    if (address >= 0x0000 && address <= 0x1FFF) {
-        ram_enabled = (value & 0x0F) == 0x0A;
+void Memory::watchCode(uint16_t address, uint16_t length) {
+    // ROM can only change through a bank switch, which codeKey already covers
+    if (address < 0x8000) {
         return;
     }
-    // --- External RAM write ---
+    // Blocks never cross a page, so the range stays inside this one. Code in WRAM can
+    // be written through echo and the other way round, both pages go on the slow path
+    unsigned int page = homePage(address);
+    for (unsigned int i = 0; i < length; ++i) {
+        _codeBytes[page].set((address + i) & (PAGE_SIZE - 1));
+    }
+    setWatched(page, true);
+}
+
+void Memory::setWatched(unsigned int page, bool watched) {
+    const unsigned int pages[2] = { page, echoPage(page) };
+    for (unsigned int p : pages) {
+        _codePages[p] = watched;
+        _writePages[p] = watched ? nullptr : _writeTargets[p];
+    }
+}
+
+uint8_t Memory::readSlow(uint16_t address) const {
     if (address >= 0xA000 && address <= 0xBFFF) {
-        if (ram_enabled) {
-            ext_ram[address - 0xA000] = value;
+        return _cart.readRAM(address);
+    }
+    if (address >= 0xFF04 && address <= 0xFF07) {
+        _readHorizon = std::min(_readHorizon, _timer.nextChange(address, now()));
+        return _timer.read(address, now());
+    }
+    if (address == 0xFF41 || address == 0xFF44) {
+        _readHorizon = std::min(_readHorizon, _ppu.nextChange(address, now()));
+        return _ppu.read(address, now());
+    }
+    return _mem[address];
+}
+
+void Memory::writeSlow(uint16_t address, uint8_t value) {
+    // --- Write to a page holding cached code ---
+    unsigned int page = address >> PAGE_SHIFT;
+    if (_codePages[page]) {
+        unsigned int home = homePage(address);
+        if (_codeBytes[home].test(address & (PAGE_SIZE - 1))) {
+            // Self-modifying code, throw away every block in the page
+            _codeBytes[home].reset();
+            _pageGeneration[home]++;
+            setWatched(home, false);
+            _sideEffects++;
+        }
+        if (_writeTargets[page]) {
+            // Plain RAM, the page only went through here because of the watch
+            _writeTargets[page][address & (PAGE_SIZE - 1)] = value;
+            return;
         }
+    }
+
+    // --- HRAM, only down here while code in the page is being watched ---
+    if (address >= HRAM_START && address <= HRAM_END) {
+        _mem[address] = value;
         return;
     }
 
-    if (address >= _mem.size()) {
-        std::cerr << "Memory write otu of bounds at: 0x" << std::hex << address << "\n";
+    // --- VRAM and OAM, lines that are already due get drawn with the old contents first.
+    // Neither can move code. Only OAM can move a deadline, when sprites stretch mode 3 ---
+    if ((address >= 0x8000 && address <= 0x9FFF) || (address >= 0xFE00 && address <= 0xFEFF)) {
+        _ppu.catchUp(now());
+        _mem[address] = value;
+        if (address < 0xA000) {
+            _ppu.vramWritten(address);
+        } else {
+            _ppu.oamWritten(address);
+            if (PPU::VARIABLE_MODE3) {
+                _sideEffects++;
+                schedulePPU(); // Mode 0 starts later or earlier with the sprites on the line
+            }
+        }
+        return;
     }
+
+    // --- MBC registers, a bank switch moves code ---
     if (address < 0x8000) {
-        std::cerr << "Attempt to write to ROM area at: " << std::hex << address << "\n";
+        _sideEffects++;
+        if (_cart.writeRegister(address, value)) {
+            mapCartridge();
+        }
+        return;
+    }
+    // --- External RAM that isn't directly mapped ---
+    if (address >= 0xA000 && address <= 0xBFFF) {
+        _cart.writeRAM(address, value);
+        return;
+    }
+
+    // The rest of the side effects are registers that move a deadline or raise an interrupt
+    if (address >= 0xFF04 && address <= 0xFF07) {
+        _sideEffects++;
+        if (_timer.write(address, value, now())) {
+            requestInterrupt(2);
+        }
+        scheduleTimer();
+        return;
+    }
+    if (address >= 0xFF40 && address <= 0xFF4B) {
+        _sideEffects++;
+        writeLCD(address, value);
         return;
     }
 
     _mem[address] = value;
 
+    if (address == 0xFF0F || address == 0xFFFF) {
+        _sideEffects++;
+        updateInterrupts();
+        return;
+    }
+
+    // Start a transfer on the internal clock. The test ROMs don't wait for one byte to
+    // finish before sending the next, so the byte is logged straight away and only the
+    // hardware side (SC clearing, the interrupt) waits for the transfer to end
     if (address == 0xFF02 && (value & 0x81) == 0x81) {
+        _sideEffects++;
         char c = _mem[0xFF01];
         std::cout << c << std::flush;
-        _mem[0xFF02] = 0; // Reset transfer control
+        serial_log += c;
+        raiseEvent(EVENT_SERIAL);
+        scheduleDevice(Scheduler::Event::Serial, now() + SERIAL_BYTE_CYCLES);
     }
-    
-}   
+}
+
+void Memory::serialDone(void* context, uint64_t /*cycle*/) {
+    Memory& mem = *static_cast<Memory*>(context);
+    mem._mem[0xFF01] = 0xFF;  // What comes in with no link partner
+    mem._mem[0xFF02] &= 0x7F; // Transfer done
+    mem.requestInterrupt(3);
+}
 
 void Memory::loadROM(const std::vector<uint8_t>& rom) {
     std::cout << "Loading ROM, size: " << rom.size() << " bytes\n";
-    size_t loadSize = std::min(rom.size(), static_cast<size_t>(0x8000));
-    std::cout << "Loading " << loadSize << " bytes into memory\n";
-    std::copy(rom.begin(), rom.begin() + loadSize, _mem.begin());
-}
\ No newline at end of file
+    _cart.load(rom);
+    mapCartridge();
+}
+
+void Memory::timerOverflow(void* context, uint64_t cycle) {
+    Memory& mem = *static_cast<Memory*>(context);
+    // Up to the overflow the event was scheduled for, reads catch up the rest themselves
+    if (mem._timer.catchUp(cycle)) {
+        mem.requestInterrupt(2);
+    }
+    mem.scheduleTimer();
+}
+
+void Memory::scheduleTimer() {
+    uint64_t next = _timer.nextInterrupt();
+    if (next == Timer::NEVER) {
+        _scheduler.cancel(Scheduler::Event::Timer);
+    } else {
+        scheduleDevice(Scheduler::Event::Timer, next);
+    }
+}
+
+void Memory::scheduleDevice(Scheduler::Event event, uint64_t cycle) {
+    // The CPU sized its current batch against the old deadline, make it look again
+    _scheduler.schedule(event, cycle);
+    stop = true;
+}
+
+void Memory::writeLCD(uint16_t address, uint8_t value) {
+    _ppu.catchUp(now());
+    if (address == 0xFF44) {
+        return; // LY is read only
+    }
+    _mem[address] = value;
+    if (address == 0xFF46) {
+        // OAM DMA, all at once rather than over 160 M-cycles
+        for (unsigned int i = 0; i < 0xA0; ++i) {
+            _mem[0xFE00 + i] = read((value << 8) + i);
+            _ppu.oamWritten(0xFE00 + i);
+        }
+        if (PPU::VARIABLE_MODE3) {
+            schedulePPU(); // New sprites, new mode 3 lengths
+        }
+        return;
+    }
+    _ppu.lcdWritten(address);
+    if (address == 0xFF40 || address == 0xFF41 || address == 0xFF45) {
+        if (_ppu.registerWritten(address, value, now()) & PPU::IRQ_STAT) {
+            requestInterrupt(1);
+        }
+        schedulePPU();
+    } else if (PPU::VARIABLE_MODE3) {
+        schedulePPU(); // SCX and the window move when mode 0 starts
+    }
+}
+
+void Memory::ppuEvent(void* context, uint64_t cycle) {
+    Memory& mem = *static_cast<Memory*>(context);
+    uint8_t irq = mem._ppu.fire(cycle, mem.now());
+    if (irq & PPU::IRQ_VBLANK) {
+        mem.requestInterrupt(0);
+        mem.raiseEvent(EVENT_VBLANK);
+    }
+    if (irq & PPU::IRQ_STAT) {
+        mem.requestInterrupt(1);
+    }
+    uint64_t next = mem._ppu.nextEvent(cycle);
+    if (next == PPU::NEVER) {
+        mem._scheduler.cancel(Scheduler::Event::PPU);
+    } else {
+        mem.scheduleDevice(Scheduler::Event::PPU, next);
+    }
+}
+
+void Memory::schedulePPU() {
+    uint64_t next = _ppu.nextEvent(now());
+    if (next == PPU::NEVER) {
+        _scheduler.cancel(Scheduler::Event::PPU);
+    } else {
+        scheduleDevice(Scheduler::Event::PPU, next);
+    }
+}
@@ -0,0 +1,556 @@
+#include "cpu.h"
+#include <utility>
+
+#if defined(GB_THREADED_DISPATCH) && !defined(__GNUC__)
+#error "GB_THREADED_DISPATCH needs computed goto (GCC or Clang)"
+#endif
+
+// Every opcode handler is generated from the opcode byte itself. The SM83 encodes
+// its instructions in regular fields:
+//
+//   x = op[7:6]   y = op[5:3]   z = op[2:0]   p = y >> 1   q = y & 1
+//
+//   r[]   = B, C, D, E, H, L, (HL), A
+//   rp[]  = BC, DE, HL, SP
+//   rp2[] = BC, DE, HL, AF
+//   cc[]  = NZ, Z, NC, C
+//   alu[] = ADD, ADC, SUB, SBC, AND, XOR, OR, CP
+//   rot[] = RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+//
+// op<OP>/cb<OP> pick the instruction with if constexpr on those fields, so the
+// tables at the bottom are just op<0x00>...op<0xFF> and every LD r,r / ALU r /
+// CB variant is the same code instantiated with a different register or bit.
+struct CPU::Ops {
+    // --- Operand helpers ---
+
+    template <int R>
+    static uint8_t& reg(CPU& cpu) {
+        static_assert(R != 6, "(HL) is a memory operand");
+        if constexpr (R == 0) return cpu._B;
+        else if constexpr (R == 1) return cpu._C;
+        else if constexpr (R == 2) return cpu._D;
+        else if constexpr (R == 3) return cpu._E;
+        else if constexpr (R == 4) return cpu._H;
+        else if constexpr (R == 5) return cpu._L;
+        else return cpu._A;
+    }
+
+    template <int R>
+    static uint8_t get(CPU& cpu) {
+        if constexpr (R == 6) return cpu._mem.read(cpu.getHL());
+        else return reg<R>(cpu);
+    }
+
+    template <int R>
+    static void set(CPU& cpu, uint8_t val) {
+        if constexpr (R == 6) cpu._mem.write(cpu.getHL(), val);
+        else reg<R>(cpu) = val;
+    }
+
+    template <int P>
+    static uint16_t getRP(CPU& cpu) {
+        if constexpr (P == 0) return cpu.getBC();
+        else if constexpr (P == 1) return cpu.getDE();
+        else if constexpr (P == 2) return cpu.getHL();
+        else return cpu._SP;
+    }
+
+    template <int P>
+    static void setRP(CPU& cpu, uint16_t val) {
+        if constexpr (P == 0) cpu.setBC(val);
+        else if constexpr (P == 1) cpu.setDE(val);
+        else if constexpr (P == 2) cpu.setHL(val);
+        else cpu._SP = val;
+    }
+
+    template <int P>
+    static uint16_t getRP2(CPU& cpu) {
+        if constexpr (P == 3) return cpu.getAF();
+        else return getRP<P>(cpu);
+    }
+
+    template <int P>
+    static void setRP2(CPU& cpu, uint16_t val) {
+        if constexpr (P == 3) cpu.setAF(val);
+        else setRP<P>(cpu, val);
+    }
+
+    template <int CC>
+    static bool cond(CPU& cpu) {
+        if constexpr (CC == 0) return !cpu.flagZ(); // NZ
+        else if constexpr (CC == 1) return cpu.flagZ(); // Z
+        else if constexpr (CC == 2) return !cpu.flagC(); // NC
+        else return cpu.flagC(); // C
+    }
+
+    template <int Y>
+    static void alu(CPU& cpu, uint8_t val) {
+        if constexpr (Y == 0) cpu.setADDFlags(val);
+        else if constexpr (Y == 1) cpu.setADCFlags(val);
+        else if constexpr (Y == 2) cpu.setSUBFlags(val);
+        else if constexpr (Y == 3) cpu.setSBCFlags(val);
+        else if constexpr (Y == 4) cpu.setANDFlags(val);
+        else if constexpr (Y == 5) cpu.setXORFlags(val);
+        else if constexpr (Y == 6) cpu.setORFlags(val);
+        else cpu.setCPFlags(val);
+    }
+
+    template <int Y>
+    static void rot(CPU& cpu, uint8_t& val) {
+        if constexpr (Y == 0) cpu.RLC(val);
+        else if constexpr (Y == 1) cpu.RRC(val);
+        else if constexpr (Y == 2) cpu.RL(val);
+        else if constexpr (Y == 3) cpu.RR(val);
+        else if constexpr (Y == 4) cpu.SLA(val);
+        else if constexpr (Y == 5) cpu.SRA(val);
+        else if constexpr (Y == 6) cpu.SWAP(val);
+        else cpu.SRL(val);
+    }
+
+    static void push(CPU& cpu, uint16_t val) { cpu.push16(val); }
+    static uint16_t pop(CPU& cpu) { return cpu.pop16(); }
+
+    // 16 bit SP + signed offset used by ADD SP,r8 and LD HL,SP+r8. Flags come from the low byte
+    static uint16_t addSPOffset(CPU& cpu) {
+        uint8_t offset = cpu.imm8();
+        uint16_t result = cpu._SP + static_cast<int8_t>(offset);
+        uint8_t f = 0;
+        if (((cpu._SP & 0x0F) + (offset & 0x0F)) > 0x0F) f |= 0x20;
+        if (((cpu._SP & 0xFF) + offset) > 0xFF) f |= 0x10;
+        cpu.setFlags(f);
+        return result;
+    }
+
+    static void unhandled(CPU& cpu, uint8_t opcode) {
+        std::cerr << "Unhandled opcode: 0x" << std::hex << (int)opcode << " at PC: 0x" << cpu._PC - 1 << std::dec << "\n";
+        cpu._halted = true;
+        cpu._unhandled = true;
+    }
+
+    // --- Instruction lengths (opcode byte included) ---
+
+    static constexpr uint8_t length(uint8_t op) {
+        uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+        if (x == 0) {
+            if (z == 0) return y == 0 ? 1 : (y == 1 ? 3 : 2);
+            if (z == 1) return (y & 1) ? 1 : 3;
+            if (z == 6) return 2;
+            return 1;
+        }
+        if (x == 3) {
+            switch (z) {
+                case 0: return y < 4 ? 1 : 2;
+                case 2: return (y < 4 || y == 5 || y == 7) ? 3 : 1;
+                case 3: return y == 0 ? 3 : (y == 1 ? 2 : 1);
+                case 4: return y < 4 ? 3 : 1;
+                case 5: return y == 1 ? 3 : 1;
+                case 6: return 2;
+                default: return 1;
+            }
+        }
+        return 1;
+    }
+
+    // --- Cycle counts in M-cycles ---
+
+    // Conditional jumps, calls and returns cost this much when they aren't taken
+    static constexpr uint8_t cycles(uint8_t op) {
+        uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7, q = y & 1;
+        if (x == 0) {
+            switch (z) {
+                case 0: return y == 1 ? 5 : (y == 3 ? 3 : (y >= 4 ? 2 : 1));
+                case 1: return q ? 2 : 3;
+                case 2: return 2;
+                case 3: return 2;
+                case 4: case 5: return y == 6 ? 3 : 1;
+                case 6: return y == 6 ? 3 : 2;
+                default: return 1;
+            }
+        }
+        if (x == 1) return (y == 6 && z == 6) ? 1 : ((y == 6 || z == 6) ? 2 : 1);
+        if (x == 2) return z == 6 ? 2 : 1;
+        switch (z) {
+            case 0: return y < 4 ? 2 : (y == 5 ? 4 : 3);
+            case 1: return q == 0 ? 3 : (y == 5 ? 1 : (y == 7 ? 2 : 4));
+            case 2: return y < 4 ? 3 : ((y & 1) ? 4 : 2);
+            case 3: return y == 0 ? 4 : (y == 1 ? 0 : 1); // CB handlers count the whole instruction
+            case 4: return y < 4 ? 3 : 1;
+            case 5: return q == 0 ? 4 : (y == 1 ? 6 : 1);
+            case 6: return 2;
+            default: return 4;
+        }
+    }
+
+    static constexpr uint8_t takenCycles(uint8_t op) {
+        uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+        if (x == 0 && z == 0 && y >= 4) return 3; // JR cc
+        if (x == 3 && y < 4) {
+            if (z == 0) return 5; // RET cc
+            if (z == 2) return 4; // JP cc
+            if (z == 4) return 6; // CALL cc
+        }
+        return cycles(op);
+    }
+
+    // Prefix included
+    static constexpr uint8_t cbCycles(uint8_t op) {
+        if ((op & 7) != 6) return 2;
+        return (op >> 6) == 1 ? 3 : 4; // BIT only reads (HL)
+    }
+
+    template <uint8_t OP>
+    static void taken(CPU& cpu) {
+        cpu._cycles += takenCycles(OP) - cycles(OP);
+    }
+
+    // --- Main opcode table ---
+
+    template <uint8_t OP>
+    static void op(CPU& cpu) {
+        constexpr int x = OP >> 6, y = (OP >> 3) & 7, z = OP & 7, p = y >> 1, q = y & 1;
+
+        cpu._cycles += cycles(OP);
+        if constexpr (x == 0) {
+            if constexpr (z == 0) {
+                if constexpr (y == 0) {
+                    // NOP
+                } else if constexpr (y == 1) { // LD (a16), SP
+                    uint16_t addr = cpu.imm16();
+                    cpu._mem.write(addr, cpu._SP & 0xFF);
+                    cpu._mem.write(addr + 1, cpu._SP >> 8);
+                } else if constexpr (y == 2) { // STOP 0
+                    // Only stops when no button is held, then waits for a press
+                    if ((cpu._mem.read(0xFF00) & 0x0F) == 0x0F) {
+                        cpu._stopped = true;
+                        cpu._halted = true;
+                    }
+                } else if constexpr (y == 3) { // JR r8
+                    cpu._PC += static_cast<int8_t>(cpu.imm8());
+                } else { // JR cc, r8
+                    if (cond<y - 4>(cpu)) {
+                        taken<OP>(cpu);
+                        cpu._PC += static_cast<int8_t>(cpu.imm8());
+                    }
+                }
+            } else if constexpr (z == 1) {
+                if constexpr (q == 0) { // LD rr, d16
+                    setRP<p>(cpu, cpu.imm16());
+                } else { // ADD HL, rr
+                    uint16_t hl = cpu.getHL();
+                    uint16_t val = getRP<p>(cpu);
+                    uint8_t f = cpu.flagZ() ? 0x80 : 0; // Z is kept, N cleared
+                    if ((hl & 0x0FFF) + (val & 0x0FFF) > 0x0FFF) f |= 0x20;
+                    if (hl + val > 0xFFFF) f |= 0x10;
+                    cpu.setFlags(f);
+                    cpu.setHL(hl + val);
+                }
+            } else if constexpr (z == 2) {
+                // LD (BC)/(DE)/(HL+)/(HL-), A and the reverse
+                uint16_t addr;
+                if constexpr (p < 2) {
+                    addr = getRP<p>(cpu);
+                } else {
+                    addr = cpu.getHL();
+                    cpu.setHL(p == 2 ? addr + 1 : addr - 1);
+                }
+                if constexpr (q == 0) cpu._mem.write(addr, cpu._A);
+                else cpu._A = cpu._mem.read(addr);
+            } else if constexpr (z == 3) { // INC rr / DEC rr
+                setRP<p>(cpu, q == 0 ? getRP<p>(cpu) + 1 : getRP<p>(cpu) - 1);
+            } else if constexpr (z == 4) { // INC r
+                uint8_t val = get<y>(cpu);
+                cpu.setINCFlags(val);
+                set<y>(cpu, val);
+            } else if constexpr (z == 5) { // DEC r
+                uint8_t val = get<y>(cpu);
+                cpu.setDECFlags(val);
+                set<y>(cpu, val);
+            } else if constexpr (z == 6) { // LD r, d8
+                set<y>(cpu, cpu.imm8());
+            } else {
+                if constexpr (y < 4) { // RLCA, RRCA, RLA, RRA always clear Z
+                    rot<y>(cpu, cpu._A);
+                    cpu.setFlags(cpu.flagC() ? 0x10 : 0);
+                } else if constexpr (y == 4) { // DAA
+                    cpu.DAA();
+                } else if constexpr (y == 5) { // CPL
+                    cpu._A = ~cpu._A;
+                    cpu.setFlags(cpu.flags() | 0x60);
+                } else if constexpr (y == 6) { // SCF
+                    cpu.setFlags((cpu.flagZ() ? 0x80 : 0) | 0x10);
+                } else { // CCF
+                    cpu.setFlags((cpu.flags() & 0x90) ^ 0x10);
+                }
+            }
+        } else if constexpr (x == 1) {
+            if constexpr (y == 6 && z == 6) { // HALT
+                if (!cpu._IME && cpu.interruptPending()) {
+                    // HALT bug could occur here (not implemented yet)
+                } else {
+                    cpu._halted = true;
+                }
+            } else { // LD r, r
+                set<y>(cpu, get<z>(cpu));
+            }
+        } else if constexpr (x == 2) { // ALU A, r
+            alu<y>(cpu, get<z>(cpu));
+        } else {
+            if constexpr (z == 0) {
+                if constexpr (y < 4) { // RET cc
+                    if (cond<y>(cpu)) {
+                        taken<OP>(cpu);
+                        cpu._PC = pop(cpu);
+                    }
+                } else if constexpr (y == 4) { // LDH (a8), A
+                    cpu._mem.write(0xFF00 + cpu.imm8(), cpu._A);
+                } else if constexpr (y == 5) { // ADD SP, r8
+                    cpu._SP = addSPOffset(cpu);
+                } else if constexpr (y == 6) { // LDH A, (a8)
+                    cpu._A = cpu._mem.read(0xFF00 + cpu.imm8());
+                } else { // LD HL, SP+r8
+                    cpu.setHL(addSPOffset(cpu));
+                }
+            } else if constexpr (z == 1) {
+                if constexpr (q == 0) { // POP rr
+                    setRP2<p>(cpu, pop(cpu));
+                } else if constexpr (p == 0) { // RET
+                    cpu._PC = pop(cpu);
+                } else if constexpr (p == 1) { // RETI
+                    cpu._PC = pop(cpu);
+                    cpu.setIME(true);
+                } else if constexpr (p == 2) { // JP (HL)
+                    cpu._PC = cpu.getHL();
+                } else { // LD SP, HL
+                    cpu._SP = cpu.getHL();
+                }
+            } else if constexpr (z == 2) {
+                if constexpr (y < 4) { // JP cc, a16
+                    if (cond<y>(cpu)) {
+                        taken<OP>(cpu);
+                        cpu._PC = cpu.imm16();
+                    }
+                } else if constexpr (y == 4) { // LD (C), A
+                    cpu._mem.write(0xFF00 + cpu._C, cpu._A);
+                } else if constexpr (y == 5) { // LD (a16), A
+                    cpu._mem.write(cpu.imm16(), cpu._A);
+                } else if constexpr (y == 6) { // LD A, (C)
+                    cpu._A = cpu._mem.read(0xFF00 + cpu._C);
+                } else { // LD A, (a16)
+                    cpu._A = cpu._mem.read(cpu.imm16());
+                }
+            } else if constexpr (z == 3) {
+                if constexpr (y == 0) { // JP a16
+                    cpu._PC = cpu.imm16();
+                } else if constexpr (y == 1) { // PREFIX CB
+                    _cbTable[cpu.imm8()](cpu);
+                } else if constexpr (y == 6) { // DI
+                    cpu.setIME(false);
+                    cpu._imeScheduled = false;
+                } else if constexpr (y == 7) { // EI
+                    cpu._imeScheduled = true;
+                } else {
+                    unhandled(cpu, OP);
+                }
+            } else if constexpr (z == 4) {
+                if constexpr (y < 4) { // CALL cc, a16
+                    if (cond<y>(cpu)) {
+                        taken<OP>(cpu);
+                        push(cpu, cpu._PC);
+                        cpu._PC = cpu.imm16();
+                    }
+                } else {
+                    unhandled(cpu, OP);
+                }
+            } else if constexpr (z == 5) {
+                if constexpr (q == 0) { // PUSH rr
+                    push(cpu, getRP2<p>(cpu));
+                } else if constexpr (p == 0) { // CALL a16
+                    push(cpu, cpu._PC);
+                    cpu._PC = cpu.imm16();
+                } else {
+                    unhandled(cpu, OP);
+                }
+            } else if constexpr (z == 6) { // ALU A, d8
+                alu<y>(cpu, cpu.imm8());
+            } else { // RST
+                push(cpu, cpu._PC);
+                cpu._PC = y * 8;
+            }
+        }
+    }
+
+    // --- CB prefixed table ---
+
+    template <uint8_t OP>
+    static void cb(CPU& cpu) {
+        constexpr int x = OP >> 6, y = (OP >> 3) & 7, z = OP & 7;
+
+        cpu._cycles += cbCycles(OP);
+        uint8_t val = get<z>(cpu);
+        if constexpr (x == 0) { // Rotates and shifts
+            rot<y>(cpu, val);
+        } else if constexpr (x == 1) { // BIT y, r
+            cpu.BIT(val, y);
+            return; // BIT never writes back
+        } else if constexpr (x == 2) { // RES y, r
+            cpu.RES(val, y);
+        } else { // SET y, r
+            cpu.SET(val, y);
+        }
+        set<z>(cpu, val);
+    }
+
+    // --- Fused instructions ---
+
+    // Runs the parts back to back behind one dispatch. The block cache only fuses
+    // sequences where nothing before the last part looks at PC or writes memory, so
+    // PC can be moved past the whole sequence up front like for a single instruction
+    template <uint8_t First, uint8_t... Rest>
+    static void fused(CPU& cpu) {
+        uint32_t operands = cpu._operand;
+        op<First>(cpu);
+        if constexpr (sizeof...(Rest) > 0) {
+            cpu._operand = operands >> (8 * (length(First) - 1));
+            fused<Rest...>(cpu);
+        }
+    }
+
+    template <uint8_t... OPS>
+    static Fusion fusion() {
+        static_assert(sizeof...(OPS) >= 2 && sizeof...(OPS) <= MAX_FUSED, "fuse 2 to MAX_FUSED instructions");
+        static_assert((0 + ... + (length(OPS) - 1)) <= 4, "operand bytes have to fit _operand");
+        return { sizeof...(OPS), {{ OPS... }}, &fused<OPS...> };
+    }
+
+    template <size_t... I>
+    static constexpr std::array<Handler, 256> opTable(std::index_sequence<I...>) {
+        return {{ &op<I>... }};
+    }
+
+    template <size_t... I>
+    static constexpr std::array<Handler, 256> cbTable(std::index_sequence<I...>) {
+        return {{ &cb<I>... }};
+    }
+
+    template <size_t... I>
+    static constexpr std::array<uint8_t, 256> lengthTable(std::index_sequence<I...>) {
+        return {{ length(I)... }};
+    }
+
+    template <size_t... I>
+    static constexpr std::array<uint8_t, 256> cyclesTable(std::index_sequence<I...>) {
+        return {{ cycles(I)... }};
+    }
+
+    template <size_t... I>
+    static constexpr std::array<uint8_t, 256> takenCyclesTable(std::index_sequence<I...>) {
+        return {{ takenCycles(I)... }};
+    }
+
+    template <size_t... I>
+    static constexpr std::array<uint8_t, 256> cbCyclesTable(std::index_sequence<I...>) {
+        return {{ cbCycles(I)... }};
+    }
+};
+
+const std::array<CPU::Handler, 256> CPU::_opTable = CPU::Ops::opTable(std::make_index_sequence<256>());
+const std::array<CPU::Handler, 256> CPU::_cbTable = CPU::Ops::cbTable(std::make_index_sequence<256>());
+const std::array<uint8_t, 256> CPU::_opLength = CPU::Ops::lengthTable(std::make_index_sequence<256>());
+const std::array<uint8_t, 256> CPU::_opCycles = CPU::Ops::cyclesTable(std::make_index_sequence<256>());
+const std::array<uint8_t, 256> CPU::_opCyclesTaken = CPU::Ops::takenCyclesTable(std::make_index_sequence<256>());
+const std::array<uint8_t, 256> CPU::_cbCycles = CPU::Ops::cbCyclesTable(std::make_index_sequence<256>());
+
+// Picked from --bench pairs on the test ROMs. Longest sequences first, the block cache takes the first match
+const std::vector<CPU::Fusion> CPU::_fusions = {
+    Ops::fusion<0xF0, 0xAD, 0x6F, 0x26>(), // LDH A,(a8) / XOR L / LD L,A / LD H,d8 (CRC table lookup)
+    Ops::fusion<0xF0, 0xAE, 0x24, 0xE0>(), // LDH A,(a8) / XOR (HL) / INC H / LDH (a8),A
+    Ops::fusion<0xF0, 0xE6, 0x20>(), // LDH A,(a8) / AND d8 / JR NZ
+    Ops::fusion<0xF0, 0xE6, 0x28>(), // LDH A,(a8) / AND d8 / JR Z
+    Ops::fusion<0x2A, 0x12>(),       // LD A,(HL+) / LD (DE),A
+    Ops::fusion<0x7E, 0xE0>(),       // LD A,(HL) / LDH (a8),A
+    Ops::fusion<0xD6, 0x30>(),       // SUB d8 / JR NC
+    Ops::fusion<0x05, 0x20>(),       // DEC B / JR NZ
+    Ops::fusion<0x0D, 0x20>(),       // DEC C / JR NZ
+    Ops::fusion<0x15, 0x20>(),       // DEC D / JR NZ
+    Ops::fusion<0x1D, 0x20>(),       // DEC E / JR NZ
+    Ops::fusion<0x3D, 0x20>(),       // DEC A / JR NZ
+    Ops::fusion<0xFE, 0x20>(),       // CP d8 / JR NZ
+    Ops::fusion<0xFE, 0x28>(),       // CP d8 / JR Z
+    Ops::fusion<0xFE, 0x30>(),       // CP d8 / JR NC
+    Ops::fusion<0xFE, 0x38>(),       // CP d8 / JR C
+};
+
+bool CPU::isFusedPair(uint8_t first, uint8_t second) {
+    for (const Fusion& fusion : _fusions) {
+        for (unsigned int i = 0; i + 1 < fusion.count; ++i) {
+            if (fusion.opcodes[i] == first && fusion.opcodes[i + 1] == second) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#ifdef GB_THREADED_DISPATCH
+
+// Expands X(00) ... X(FF) so the threaded loop can stamp out one label per opcode
+#define GB_OPCODE_ROW(X, h) \
+    X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) \
+    X(h##8) X(h##9) X(h##A) X(h##B) X(h##C) X(h##D) X(h##E) X(h##F)
+#define GB_ALL_OPCODES(X) \
+    GB_OPCODE_ROW(X, 0) GB_OPCODE_ROW(X, 1) GB_OPCODE_ROW(X, 2) GB_OPCODE_ROW(X, 3) \
+    GB_OPCODE_ROW(X, 4) GB_OPCODE_ROW(X, 5) GB_OPCODE_ROW(X, 6) GB_OPCODE_ROW(X, 7) \
+    GB_OPCODE_ROW(X, 8) GB_OPCODE_ROW(X, 9) GB_OPCODE_ROW(X, A) GB_OPCODE_ROW(X, B) \
+    GB_OPCODE_ROW(X, C) GB_OPCODE_ROW(X, D) GB_OPCODE_ROW(X, E) GB_OPCODE_ROW(X, F)
+
+unsigned int CPU::executeThreaded(unsigned int count) {
+    #define GB_LABEL_ADDRESS(n) &&op_##n,
+    static const void* const labels[256] = { GB_ALL_OPCODES(GB_LABEL_ADDRESS) };
+    #undef GB_LABEL_ADDRESS
+
+    uint8_t opcode;
+
+    // Same per instruction work as step(), copied into the tail of every handler so
+    // the host predictor sees a separate indirect jump per opcode
+    #define GB_DISPATCH() \
+        do { \
+            if (_imeScheduled) { \
+                setIME(true); \
+                _imeScheduled = false; \
+            } \
+            if (_mem.stop || _halted || count == 0) return count; \
+            --count; \
+            if (_mem.dispatchableInterrupts()) { \
+                serviceInterrupt(); \
+                if (count == 0) return 0; \
+                --count; \
+            } \
+            opcode = fetch8(); \
+            if (_opLength[opcode] == 2) { \
+                _operand = fetch8(); \
+            } else if (_opLength[opcode] == 3) { \
+                _operand = fetch16(); \
+            } \
+            goto *labels[opcode]; \
+        } while (0)
+
+    // The first instruction goes through step() so halt/interrupt wake-up stays in one place
+    if (count == 0) return 0;
+    step();
+    --count;
+    if (_halted || _mem.stop) return count;
+    GB_DISPATCH();
+
+    #define GB_HANDLER(n) \
+        op_##n: \
+            Ops::op<0x##n>(*this); \
+            GB_DISPATCH();
+    GB_ALL_OPCODES(GB_HANDLER)
+    #undef GB_HANDLER
+    #undef GB_DISPATCH
+}
+
+#undef GB_ALL_OPCODES
+#undef GB_OPCODE_ROW
+
+#endif
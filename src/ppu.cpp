@@ -0,0 +1,302 @@
+#include "ppu.h"
+#include <iostream>
+#include "renderthread.h"
+
+template <typename Renderer>
+BasicPPU<Renderer>::BasicPPU(const uint8_t* mem) : _mem(mem), _renderer(mem) {}
+
+template <typename Renderer>
+BasicPPU<Renderer>::~BasicPPU() = default;
+
+template <typename Renderer>
+void BasicPPU<Renderer>::journal(uint16_t address) {
+    _thread->write(address, _mem[address]);
+}
+
+template <typename Renderer>
+void BasicPPU<Renderer>::lcdWritten(uint16_t address) {
+    if (_thread) {
+        journal(address);
+    } else if (address == 0xFF40) {
+        _renderer.lcdcWritten(_mem[address]);
+    }
+}
+
+template <typename Renderer>
+void BasicPPU<Renderer>::setRenderThread(bool enabled) {
+    if constexpr (Renderer::MID_LINE) {
+        if (enabled) {
+            std::cerr << "No render thread with the pixel FIFO renderer, drawing inline\n";
+        }
+        return;
+    } else if (enabled && !_thread) {
+        _thread = std::make_unique<RenderThread>(_mem, _renderer);
+    } else if (!enabled && _thread) {
+        _thread->takeHashes(_frameHashes);
+        _renderer.resync(_thread->renderer());
+        _thread.reset();
+    }
+}
+
+template <typename Renderer>
+const std::vector<uint64_t>& BasicPPU<Renderer>::frameHashes() {
+    if (_thread) {
+        _thread->takeHashes(_frameHashes);
+    }
+    return _frameHashes;
+}
+
+template <typename Renderer>
+const uint32_t* BasicPPU<Renderer>::framebuffer() const {
+    if (_thread) {
+        _thread->flush();
+        return _thread->renderer().framebuffer();
+    }
+    return _renderer.framebuffer();
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::framebufferChanged() {
+    if (_thread) {
+        _thread->flush();
+        return _thread->takeChanged();
+    }
+    return _renderer.takeChanged();
+}
+
+template <typename Renderer>
+uint8_t BasicPPU<Renderer>::mode(uint64_t cycle) const {
+    if (!_enabled) {
+        return 0;
+    }
+    if (line(cycle) >= HEIGHT) {
+        return 1;
+    }
+    unsigned int d = dot(cycle);
+    if (d < MODE2_CYCLES) return 2;
+    if (d < MODE2_CYCLES + mode3Cycles(line(cycle))) return 3;
+    return 0;
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::statLine(uint64_t cycle) const {
+    if (!_enabled) {
+        return false;
+    }
+    uint8_t m = mode(cycle);
+    return ((_stat & 0x08) && m == 0) || ((_stat & 0x10) && m == 1) || ((_stat & 0x20) && m == 2) ||
+           ((_stat & 0x40) && line(cycle) == _lyc);
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::statRises(uint64_t cycle) const {
+    // Only the rising edge of the OR'd line interrupts, a source coming on while another
+    // holds it high does nothing
+    return statLine(cycle) && !(cycle > _start && statLine(cycle - 1));
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::isVBlankStart(uint64_t cycle) const {
+    return _enabled && cycle >= _start && (cycle - _start) % FRAME_CYCLES == HEIGHT * LINE_CYCLES;
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::runLine(uint64_t now) {
+    if constexpr (Renderer::MID_LINE) {
+        uint64_t mode3Start = _start + (_nextLine - 1) * LINE_CYCLES + MODE2_CYCLES;
+        if (_renderer.runTo((now - mode3Start) * 4)) {
+            _lineOpen = false;
+        }
+    }
+    return !_lineOpen;
+}
+
+template <typename Renderer>
+void BasicPPU<Renderer>::catchUp(uint64_t now) {
+    if (!_enabled || now < _start) {
+        return;
+    }
+    uint64_t lines = (now - _start) / LINE_CYCLES;
+    if (lines > _nextLine + LINES) {
+        _nextLine = lines - lines % LINES; // More than a frame behind, the old one is gone anyway
+        _lineOpen = false;
+    }
+    if constexpr (Renderer::MID_LINE) {
+        if (_lineOpen && !runLine(now)) {
+            return; // Still in its mode 3, no later line can have started
+        }
+    }
+    // LineRenderer draws a line with whatever state it sees when mode 3 starts, a
+    // MID_LINE one runs it up to now and picks up from there next time
+    while (_nextLine <= lines && _start + _nextLine * LINE_CYCLES + MODE2_CYCLES <= now) {
+        unsigned int ly = _nextLine % LINES;
+        if (ly == 0) {
+            _drawing = drawsNextFrame();
+        }
+        // A skipped frame fetches and mixes nothing, the timing doesn't depend on any of it
+        if (_drawing && _thread) {
+            if (ly == 0) {
+                _thread->startFrame();
+            }
+            if (ly < HEIGHT) {
+                _thread->renderLine(ly);
+            }
+        } else if (_drawing) {
+            if (ly == 0) {
+                _renderer.startFrame();
+            }
+            if constexpr (Renderer::MID_LINE) {
+                if (ly < HEIGHT) {
+                    _renderer.beginLine(ly);
+                    _lineOpen = true;
+                    _nextLine++;
+                    if (!runLine(now)) {
+                        return;
+                    }
+                    continue;
+                }
+            } else if (ly < HEIGHT) {
+                _renderer.renderLine(ly);
+            }
+        }
+        _nextLine++;
+    }
+}
+
+template <typename Renderer>
+void BasicPPU<Renderer>::setDrawPolicy(DrawPolicy policy, unsigned int n) {
+    _drawPolicy = policy;
+    _drawEvery = n ? n : 1;
+}
+
+template <typename Renderer>
+bool BasicPPU<Renderer>::drawsNextFrame() {
+    switch (_drawPolicy) {
+        case DrawPolicy::EveryNth:
+            return _frames % _drawEvery == 0;
+        case DrawPolicy::OnRequest: {
+            bool requested = _frameRequested;
+            _frameRequested = false;
+            return requested;
+        }
+        case DrawPolicy::Never:
+            return false;
+        default:
+            return true;
+    }
+}
+
+template <typename Renderer>
+uint8_t BasicPPU<Renderer>::read(uint16_t address, uint64_t now) const {
+    unsigned int ly = _enabled ? line(now) : 0;
+    if (address == 0xFF44) {
+        return ly;
+    }
+    return 0x80 | _stat | (ly == _lyc ? 0x04 : 0) | mode(now);
+}
+
+template <typename Renderer>
+uint8_t BasicPPU<Renderer>::registerWritten(uint16_t address, uint8_t value, uint64_t now) {
+    if (address == 0xFF40) {
+        if ((value & 0x80) && !_enabled) {
+            // Starts from the top of a frame
+            _enabled = true;
+            _start = now;
+            _nextLine = 0;
+        } else if (!(value & 0x80) && _enabled) {
+            _enabled = false;
+            _lineOpen = false;
+            if (_thread) {
+                _thread->clear();
+            } else {
+                _renderer.clear();
+            }
+        }
+        return 0;
+    }
+    bool before = statLine(now);
+    if (address == 0xFF41) {
+        _stat = value & 0x78;
+    } else if (address == 0xFF45) {
+        _lyc = value;
+    }
+    return !before && statLine(now) ? IRQ_STAT : 0;
+}
+
+template <typename Renderer>
+uint64_t BasicPPU<Renderer>::nextEvent(uint64_t after) const {
+    if (!_enabled) {
+        return NEVER;
+    }
+    uint64_t frame = after < _start ? _start : after - (after - _start) % FRAME_CYCLES;
+    uint64_t vblank = frame + HEIGHT * LINE_CYCLES;
+    if (vblank <= after) {
+        vblank += FRAME_CYCLES;
+    }
+    if (!(_stat & 0x78)) {
+        return vblank;
+    }
+    // The STAT line can only change where a mode or line starts, look for the first rise
+    // before vblank. At most a frame of lines, and only when STAT interrupts are on
+    for (uint64_t n = after < _start ? 0 : (after - _start) / LINE_CYCLES; ; ++n) {
+        uint64_t lineStart = _start + n * LINE_CYCLES;
+        unsigned int boundaries = n % LINES < HEIGHT ? 3 : 1;
+        const uint64_t offsets[3] = { 0, MODE2_CYCLES, boundaries == 3 ? MODE2_CYCLES + mode3Cycles(n % LINES) : 0 };
+        for (unsigned int i = 0; i < boundaries; ++i) {
+            uint64_t cycle = lineStart + offsets[i];
+            if (cycle <= after) {
+                continue;
+            }
+            if (cycle >= vblank) {
+                return vblank;
+            }
+            if (statRises(cycle)) {
+                return cycle;
+            }
+        }
+    }
+}
+
+template <typename Renderer>
+uint8_t BasicPPU<Renderer>::fire(uint64_t cycle, uint64_t now) {
+    catchUp(now);
+    uint8_t irq = 0;
+    if (isVBlankStart(cycle)) {
+        irq |= IRQ_VBLANK;
+        _frames++;
+        if (_drawing) {
+            _framesDrawn++;
+        }
+        if (_hashFrames) {
+            if (_thread) {
+                _thread->hashFrame();
+            } else {
+                _frameHashes.push_back(_renderer.hash());
+            }
+        }
+    }
+    if (statRises(cycle)) {
+        irq |= IRQ_STAT;
+    }
+    return irq;
+}
+
+template <typename Renderer>
+uint64_t BasicPPU<Renderer>::nextChange(uint16_t address, uint64_t now) const {
+    if (!_enabled) {
+        return NEVER;
+    }
+    unsigned int d = dot(now);
+    if (address == 0xFF41 && line(now) < HEIGHT) {
+        uint64_t mode0 = MODE2_CYCLES + mode3Cycles(line(now));
+        if (d < MODE2_CYCLES) return now + MODE2_CYCLES - d;
+        if (d < mode0) return now + mode0 - d;
+    }
+    return now + LINE_CYCLES - d;
+}
+
+#ifdef GB_PIXEL_FIFO
+template class BasicPPU<FifoRenderer>;
+#else
+template class BasicPPU<LineRenderer>;
+#endif
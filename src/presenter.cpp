@@ -0,0 +1,97 @@
+#include "presenter.h"
+#include <SDL3/SDL.h>
+#include <cstring>
+#include <iostream>
+
+Presenter::~Presenter() {
+    if (_texture) {
+        SDL_DestroyTexture(_texture);
+    }
+    if (_renderer) {
+        SDL_DestroyRenderer(_renderer);
+    }
+    if (_window) {
+        SDL_DestroyWindow(_window);
+    }
+    if (_window || _renderer) {
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+}
+
+bool Presenter::open(const char* title, int scale) {
+    if (!SDL_InitSubSystem(SDL_INIT_VIDEO)) {
+        std::cerr << "SDL video init failed: " << SDL_GetError() << "\n";
+        return false;
+    }
+    if (!SDL_CreateWindowAndRenderer(title, PPU::WIDTH * scale, PPU::HEIGHT * scale, SDL_WINDOW_RESIZABLE,
+                                     &_window, &_renderer)) {
+        std::cerr << "Failed to create a window: " << SDL_GetError() << "\n";
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return false;
+    }
+    // The framebuffer is 0xRRGGBBAA per uint32_t, which is what RGBA8888 means to SDL
+    _texture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                 PPU::WIDTH, PPU::HEIGHT);
+    if (!_texture) {
+        std::cerr << "Failed to create the screen texture: " << SDL_GetError() << "\n";
+        return false;
+    }
+    SDL_SetTextureScaleMode(_texture, SDL_SCALEMODE_NEAREST);
+    SDL_SetRenderLogicalPresentation(_renderer, PPU::WIDTH, PPU::HEIGHT, SDL_LOGICAL_PRESENTATION_INTEGER_SCALE);
+    // Not every driver can (dummy and offscreen can't), then presents just don't wait
+    SDL_SetRenderVSync(_renderer, 1);
+    _running = true;
+    return true;
+}
+
+void Presenter::submit(const uint32_t* framebuffer, bool changed) {
+    _submitted++;
+    if (!changed) {
+        _unchanged++;
+        return;
+    }
+    std::memcpy(_frames.back().data(), framebuffer, sizeof(Frame));
+    _frames.publish();
+}
+
+void Presenter::present(const Frame& frame) {
+    // Rows go straight from the triple buffer slot into the texture's memory, the
+    // pitch SDL hands back can be wider than a row
+    void* pixels;
+    int pitch;
+    if (!SDL_LockTexture(_texture, nullptr, &pixels, &pitch)) {
+        return;
+    }
+    const size_t row = PPU::WIDTH * sizeof(uint32_t);
+    if (static_cast<size_t>(pitch) == row) {
+        std::memcpy(pixels, frame.data(), sizeof(Frame));
+    } else {
+        for (unsigned int y = 0; y < PPU::HEIGHT; ++y) {
+            std::memcpy(static_cast<uint8_t*>(pixels) + y * pitch, frame.data() + y * PPU::WIDTH, row);
+        }
+    }
+    SDL_UnlockTexture(_texture);
+
+    SDL_RenderClear(_renderer);
+    SDL_RenderTexture(_renderer, _texture, nullptr, nullptr);
+    SDL_RenderPresent(_renderer); // Blocks for vsync when there is one, emulation carries on meanwhile
+    _presented++;
+}
+
+void Presenter::run() {
+    SDL_Event event;
+    while (_running) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) {
+                _running = false;
+            }
+        }
+        if (_frames.update()) {
+            present(_frames.front());
+        } else {
+            // Nothing new, an unchanged screen costs no presents. Sleep until an event
+            // or long enough for the next frame to have turned up
+            SDL_WaitEventTimeout(nullptr, 2);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include "renderthread.h"
+#include <algorithm>
+
+RenderThread::RenderThread(const uint8_t* mem, const LineRenderer& current) : _renderer(_mem.data()) {
+    std::copy(mem, mem + _mem.size(), _mem.begin());
+    _renderer.resync(current);
+    _thread = std::thread(&RenderThread::run, this);
+}
+
+RenderThread::~RenderThread() {
+    pushAndWake(Entry{ STOP, 0, 0 });
+    _thread.join();
+}
+
+void RenderThread::push(const Entry& entry) {
+    while (!_ring.push(entry)) {
+        // Full, a long run of writes with no line marker could have left the worker asleep
+        wake();
+        std::this_thread::yield();
+    }
+}
+
+void RenderThread::pushAndWake(const Entry& entry) {
+    push(entry);
+    wake();
+}
+
+void RenderThread::wake() {
+    // Pairs with the fence in run(): either the worker sees the entry before it sleeps,
+    // or this sees it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _wake.notify_one();
+    }
+}
+
+void RenderThread::flush() {
+    pushAndWake(Entry{ SYNC, 0, 0 });
+    _syncsSent++;
+    while (_syncsDone.load(std::memory_order_acquire) != _syncsSent) {
+        std::this_thread::yield();
+    }
+}
+
+void RenderThread::takeHashes(std::vector<uint64_t>& hashes) {
+    flush();
+    hashes.insert(hashes.end(), _hashes.begin(), _hashes.end());
+    _hashes.clear();
+}
+
+void RenderThread::run() {
+    const unsigned int SPINS = 256; // Empty polls before going to sleep
+    unsigned int idle = 0;
+    Entry entry;
+    while (true) {
+        if (_ring.pop(entry)) {
+            idle = 0;
+            if (entry.kind == STOP) {
+                return;
+            }
+            apply(entry);
+            continue;
+        }
+        if (++idle < SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _wake.wait(lock, [this] { return !_ring.empty(); });
+        _sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+void RenderThread::apply(const Entry& entry) {
+    switch (entry.kind) {
+        case WRITE:
+            _mem[entry.address] = entry.value;
+            if (entry.address < 0xA000) {
+                _renderer.vramWritten(entry.address);
+            } else if (entry.address < 0xFF00) {
+                _renderer.oamWritten(entry.address);
+            } else if (entry.address == 0xFF40) {
+                _renderer.lcdcWritten(entry.value);
+            }
+            break;
+        case START_FRAME:
+            _renderer.startFrame();
+            break;
+        case LINE:
+            _renderer.renderLine(entry.address);
+            break;
+        case CLEAR:
+            _renderer.clear();
+            break;
+        case HASH:
+            _hashes.push_back(_renderer.hash());
+            break;
+        case SYNC:
+            _syncsDone.fetch_add(1, std::memory_order_release);
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,102 @@
+#include "scheduler.h"
+
+Scheduler::Scheduler() {
+    _position.fill(-1);
+    _handlers.fill(Handler{ nullptr, nullptr });
+}
+
+void Scheduler::setHandler(Event event, Callback callback, void* context) {
+    _handlers[index(event)] = Handler{ callback, context };
+}
+
+void Scheduler::schedule(Event event, uint64_t cycle) {
+    int8_t slot = _position[index(event)];
+    if (slot < 0) {
+        place(_count++, Entry{ cycle, event });
+        siftUp(_count - 1);
+        return;
+    }
+    // Already pending, move it whichever way the new deadline needs
+    uint64_t old = _heap[slot].cycle;
+    _heap[slot].cycle = cycle;
+    if (cycle < old) {
+        siftUp(slot);
+    } else {
+        siftDown(slot);
+    }
+}
+
+void Scheduler::cancel(Event event) {
+    int8_t slot = _position[index(event)];
+    if (slot >= 0) {
+        removeAt(slot);
+    }
+}
+
+uint64_t Scheduler::when(Event event) const {
+    int8_t slot = _position[index(event)];
+    return slot < 0 ? UINT64_MAX : _heap[slot].cycle;
+}
+
+void Scheduler::run(uint64_t now) {
+    while (_count && _heap[0].cycle <= now) {
+        Entry due = _heap[0];
+        removeAt(0);
+        _fired++;
+        const Handler& handler = _handlers[index(due.event)];
+        if (handler.callback) {
+            handler.callback(handler.context, due.cycle);
+        }
+    }
+}
+
+void Scheduler::place(size_t slot, const Entry& entry) {
+    _heap[slot] = entry;
+    _position[index(entry.event)] = static_cast<int8_t>(slot);
+}
+
+void Scheduler::siftUp(size_t slot) {
+    Entry entry = _heap[slot];
+    while (slot > 0) {
+        size_t parent = (slot - 1) / 2;
+        if (!before(entry, _heap[parent])) {
+            break;
+        }
+        place(slot, _heap[parent]);
+        slot = parent;
+    }
+    place(slot, entry);
+}
+
+void Scheduler::siftDown(size_t slot) {
+    Entry entry = _heap[slot];
+    while (true) {
+        size_t child = slot * 2 + 1;
+        if (child >= _count) {
+            break;
+        }
+        if (child + 1 < _count && before(_heap[child + 1], _heap[child])) {
+            child++;
+        }
+        if (!before(_heap[child], entry)) {
+            break;
+        }
+        place(slot, _heap[child]);
+        slot = child;
+    }
+    place(slot, entry);
+}
+
+void Scheduler::removeAt(size_t slot) {
+    _position[index(_heap[slot].event)] = -1;
+    if (--_count == slot) {
+        return;
+    }
+    // Fill the hole with the last entry and let it settle in either direction
+    place(slot, _heap[_count]);
+    if (slot > 0 && before(_heap[slot], _heap[(slot - 1) / 2])) {
+        siftUp(slot);
+    } else {
+        siftDown(slot);
+    }
+}
@@ -0,0 +1,62 @@
+#include "spritebuckets.h"
+#include "utils.h"
+
+SpriteBuckets::SpriteBuckets(const uint8_t* oam) : _oam(oam) {
+    // OAM starts out zeroed and Y 0 is above the screen, so nothing covers any line.
+    // Memory fills it after the PPU is built, so don't look at it here
+    _lines.fill(0);
+    _y.fill(0);
+}
+
+// Sets or clears the sprite's bit on every visible line it covers at its filed Y
+void SpriteBuckets::place(unsigned int sprite, bool covered) {
+    int top = _y[sprite] - 16;
+    uint64_t bit = uint64_t(1) << sprite;
+    for (int ly = top < 0 ? 0 : top; ly < top + static_cast<int>(_height) && ly < static_cast<int>(HEIGHT); ++ly) {
+        if (covered) {
+            _lines[ly] |= bit;
+        } else {
+            _lines[ly] &= ~bit;
+        }
+    }
+}
+
+void SpriteBuckets::oamWritten(uint16_t address) {
+    unsigned int offset = address - 0xFE00;
+    if (offset >= SPRITE_COUNT * 4 || offset & 3) {
+        return; // X, tile and flags are read when drawing, past 0xFE9F isn't OAM
+    }
+    unsigned int sprite = offset / 4;
+    if (_y[sprite] == _oam[offset]) {
+        return;
+    }
+    place(sprite, false);
+    _y[sprite] = _oam[offset];
+    place(sprite, true);
+}
+
+void SpriteBuckets::setHeight(unsigned int height) {
+    if (height == _height) {
+        return;
+    }
+    _lines.fill(0);
+    _height = height;
+    for (unsigned int sprite = 0; sprite < SPRITE_COUNT; ++sprite) {
+        place(sprite, true);
+    }
+}
+
+unsigned int SpriteBuckets::line(unsigned int ly, std::array<uint8_t, LINE_LIMIT>& sprites) const {
+    unsigned int count = 0;
+    for (uint64_t mask = _lines[ly]; mask && count < LINE_LIMIT; mask &= mask - 1) {
+        uint8_t sprite = lowestSetBit64(mask);
+        // Insertion sort by X, equal X stays in OAM order since those come in ascending
+        unsigned int i = count++;
+        while (i > 0 && _oam[sprites[i - 1] * 4 + 1] > _oam[sprite * 4 + 1]) {
+            sprites[i] = sprites[i - 1];
+            --i;
+        }
+        sprites[i] = sprite;
+    }
+    return count;
+}
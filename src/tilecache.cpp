@@ -0,0 +1,18 @@
+#include "tilecache.h"
+
+TileCache::TileCache(const uint8_t* vram) : _vram(vram) {
+    _dirty.set(); // Nothing decoded yet
+}
+
+void TileCache::decode(unsigned int tile) {
+    const uint8_t* data = &_vram[tile * 16];
+    uint8_t* out = _tiles[tile].data();
+    for (unsigned int y = 0; y < 8; ++y) {
+        uint8_t low = data[y * 2], high = data[y * 2 + 1];
+        for (unsigned int x = 0; x < 8; ++x) {
+            unsigned int bit = 7 - x;
+            out[y * 8 + x] = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+        }
+    }
+    _dirty.reset(tile);
+}
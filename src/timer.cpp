@@ -0,0 +1,141 @@
+#include "timer.h"
+
+namespace {
+
+// Counter ticks per TIMA increment for each TAC clock select
+const uint64_t PERIODS[4] = { 1024, 16, 64, 256 };
+
+}
+
+Timer::Timer() {
+    // Where the DMG boot ROM leaves things: DIV 0xAB, TIMA/TMA/TAC 0
+    _counterBase = 0xABCC;
+}
+
+uint64_t Timer::period() const {
+    return PERIODS[_tac & 0x03];
+}
+
+uint64_t Timer::edgeCycle(uint64_t n) const {
+    uint64_t start = counter(_synced);
+    uint64_t edge = (start / period() + n) * period();
+    return _synced + (edge - start) / 4;
+}
+
+bool Timer::catchUp(uint64_t now) {
+    bool interrupt = false;
+    while (true) {
+        if (_reload != NEVER) {
+            if (_reload > now) {
+                break; // Still in the cycle TIMA reads 0, no edge can land in there
+            }
+            _tima = _tma;
+            _synced = _reload;
+            _reload = NEVER;
+            interrupt = true;
+        }
+        if (!enabled() || now <= _synced) {
+            break;
+        }
+        uint64_t edges = counter(now) / period() - counter(_synced) / period();
+        if (_tima + edges <= 0xFF) {
+            _tima += edges;
+            break;
+        }
+        // Overflows on the way, go round again from that edge
+        uint64_t overflow = edgeCycle(0x100 - _tima);
+        _tima = 0;
+        _synced = overflow;
+        _reload = overflow + 1;
+    }
+    if (now > _synced) {
+        _synced = now;
+    }
+    return interrupt;
+}
+
+void Timer::increment(uint64_t now) {
+    if (_tima == 0xFF) {
+        _tima = 0;
+        _reload = now + 1;
+    } else {
+        _tima++;
+    }
+}
+
+uint8_t Timer::read(uint16_t address, uint64_t now) const {
+    switch (address) {
+        case 0xFF04:
+            return (counter(now) >> 8) & 0xFF;
+        case 0xFF05: {
+            // Catch up a copy, the real state only moves on writes and the overflow event
+            Timer timer = *this;
+            timer.catchUp(now);
+            return timer._tima;
+        }
+        case 0xFF06:
+            return _tma;
+        default:
+            return _tac | 0xF8;
+    }
+}
+
+bool Timer::write(uint16_t address, uint8_t value, uint64_t now) {
+    bool interrupt = catchUp(now);
+    switch (address) {
+        case 0xFF04: {
+            // The selected bit drops with the rest of the counter, which TIMA sees as an edge
+            bool edge = signal(now);
+            _counterBase = 0 - now * 4;
+            if (edge) {
+                increment(now);
+            }
+            break;
+        }
+        case 0xFF05:
+            // Writing in the cycle TIMA reads 0 cancels the reload and the interrupt
+            _tima = value;
+            _reload = NEVER;
+            break;
+        case 0xFF06:
+            _tma = value;
+            break;
+        case 0xFF07: {
+            // Same glitch as DIV, switching to a bit that's low (or disabling) while the
+            // old one was high is a falling edge
+            bool before = signal(now);
+            _tac = value & 0x07;
+            if (before && !signal(now)) {
+                increment(now);
+            }
+            break;
+        }
+    }
+    return interrupt;
+}
+
+uint64_t Timer::nextInterrupt() const {
+    if (_reload != NEVER) {
+        return _reload;
+    }
+    if (!enabled()) {
+        return NEVER;
+    }
+    return edgeCycle(0x100 - _tima) + 1;
+}
+
+uint64_t Timer::nextChange(uint16_t address, uint64_t now) const {
+    if (address == 0xFF04) {
+        uint64_t count = counter(now);
+        return now + ((count / 256 + 1) * 256 - count) / 4;
+    }
+    if (address == 0xFF05) {
+        Timer timer = *this;
+        timer.catchUp(now);
+        if (timer._reload != NEVER) {
+            return timer._reload;
+        }
+        return timer.enabled() ? timer.edgeCycle(1) : NEVER;
+    }
+    return NEVER;
+}